@@ -0,0 +1,74 @@
+// Refresh overhead accounting, see accounting.h
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "accounting.h"
+
+RefreshAccounting::RefreshAccounting(const Topology &t, uint32_t base, const DramTiming &timing)
+    : topo(t), base_trefi(base), timings(t.size(), timing), accounts(t.size()), last(t.size(), 0) {}
+
+void RefreshAccounting::update(int channel, uint64_t time_us, uint32_t trefi, double read_mbps, double write_mbps) {
+    RefreshAccount &a = accounts[channel];
+    uint64_t &l = last[channel];
+
+    // the previous state held until now
+    if (l && time_us > l) {
+        const double dt = (time_us - l) / 1e6;
+        a.seconds += dt;
+        a.duty_s += a.duty * dt;
+        a.reclaimed_s += a.reclaimed * dt;
+        a.theoretical_mb += a.theoretical_mbps * dt;
+        a.gain_mb += a.gain_mbps * dt;
+    }
+
+    const DramTiming &t = timings[channel];
+    const double trfc = t.trfc_ck;
+    const double mbps = std::max(0.0, read_mbps) + std::max(0.0, write_mbps); // -1 for an inactive channel
+    a.duty = trefi ? std::min(1.0, trfc / trefi) : 0;
+    a.reclaimed = base_trefi ? std::min(1.0, trfc / base_trefi) - a.duty : 0;
+    a.theoretical_mbps = t.peakMbps() * a.reclaimed;
+    a.gain_mbps = a.duty < 1 ? mbps * a.reclaimed / (1 - a.duty) : 0;
+    l = time_us;
+}
+
+static void report_row(std::ostream &out, const std::string &name, const RefreshAccount &a, double channels) {
+    char buf[256];
+    const double s = a.seconds > 0 ? a.seconds : 1;
+    snprintf(buf, sizeof(buf), " %-14s refresh duty %6.3f%%, reclaimed %6.3f%% of time, %8.1f MB/s theoretical, %8.1f MB/s measured gain\n",
+             name.c_str(), 100 * a.duty_s / s / channels, 100 * a.reclaimed_s / s / channels, a.theoretical_mb / s, a.gain_mb / s);
+    out << buf;
+}
+
+void RefreshAccounting::report(std::ostream &out) const {
+    RefreshAccount host;
+    std::vector<RefreshAccount> nodes;
+    std::vector<int> node_channels;
+    for (size_t i = 0; i < topo.size(); i++) {
+        const RefreshAccount &a = accounts[i];
+        report_row(out, channel_name(topo[i]), a, 1);
+        const uint32_t s = topo[i].socket;
+        if (nodes.size() <= s) {
+            nodes.resize(s + 1);
+            node_channels.resize(s + 1, 0);
+        }
+        // sums of per-channel averages, so channels with fewer samples count the same
+        const double secs = a.seconds > 0 ? a.seconds : 1;
+        RefreshAccount *sums[2] = {&nodes[s], &host};
+        for (int k = 0; k < 2; k++) {
+            sums[k]->seconds = 1;
+            sums[k]->duty_s += a.duty_s / secs;
+            sums[k]->reclaimed_s += a.reclaimed_s / secs;
+            sums[k]->theoretical_mb += a.theoretical_mb / secs;
+            sums[k]->gain_mb += a.gain_mb / secs;
+        }
+        node_channels[s]++;
+    }
+    for (size_t s = 0; s < nodes.size(); s++) {
+        if (node_channels[s])
+            report_row(out, "S" + std::to_string(s), nodes[s], node_channels[s]);
+    }
+    if (!topo.empty())
+        report_row(out, "host", host, topo.size());
+}
@@ -0,0 +1,65 @@
+// Refresh overhead accounting
+//
+// A channel spends tRFC out of every tREFI refreshing, so its refresh duty
+// cycle is tRFC / tREFI and every clock the controller adds to tREFI hands
+// time back to reads and writes. Per channel this keeps, as the latest value
+// and time weighted over the run:
+//   duty         tRFC / tREFI of the register
+//   reclaimed    duty at base_trefi minus duty, fraction of time given back
+//   theoretical  peak bandwidth * reclaimed, the most the channel could gain
+//   gain         measured bandwidth * reclaimed / (1 - duty), what the
+//                traffic seen actually gained if it was bandwidth bound
+// and sums them per node (socket) and for the host.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <iostream>
+#include <vector>
+
+#include "topology.h"
+
+struct DramTiming {
+    double tck_ns;    // DRAM clock period
+    uint32_t trfc_ck; // refresh cycle time in clocks
+
+    DramTiming() : tck_ns(1.0714), trfc_ck(0) {} // 1866 MT/s
+
+    // two transfers of 8 bytes per clock
+    double peakMbps() const { return 2 * 8 * 1000 / tck_ns; }
+};
+
+struct RefreshAccount {
+    // latest
+    double duty, reclaimed;
+    double theoretical_mbps, gain_mbps;
+    // integrals over seconds
+    double seconds;
+    double duty_s, reclaimed_s;
+    double theoretical_mb, gain_mb;
+
+    RefreshAccount() : duty(0), reclaimed(0), theoretical_mbps(0), gain_mbps(0), seconds(0), duty_s(0), reclaimed_s(0), theoretical_mb(0), gain_mb(0) {}
+};
+
+class RefreshAccounting {
+  public:
+    RefreshAccounting(const Topology &topo, uint32_t base_trefi, const DramTiming &timing);
+
+    void setTiming(int channel, const DramTiming &t) { timings[channel] = t; }
+    const DramTiming &timing(int channel) const { return timings[channel]; }
+
+    // the channel runs at trefi with that traffic from time_us on
+    void update(int channel, uint64_t time_us, uint32_t trefi, double read_mbps, double write_mbps);
+    const RefreshAccount &channel(int i) const { return accounts[i]; }
+
+    // run averages per channel, node and host
+    void report(std::ostream &out) const;
+
+  private:
+    Topology topo;
+    uint32_t base_trefi;
+    std::vector<DramTiming> timings;
+    std::vector<RefreshAccount> accounts;
+    std::vector<uint64_t> last; // time_us of the latest update
+};
@@ -22,12 +22,29 @@
 #define CH_D_Func 0x1
 #define CH_D_Err_Func 0x3
 
+// per socket iMC layout (Haswell-EP/Broadwell-EP), thermal control on func 0/1
+// and error registers on func 2/3 of every device, two channels per device
+#define IMC0_CH01_Device 0x14
+#define IMC0_CH23_Device 0x15
+#define IMC1_CH01_Device 0x17
+#define IMC1_CH23_Device 0x18
+#define max_imc_per_socket 2
+#define max_channel_per_imc 4
+
+// device ids of the iMC channel functions are base + 0..7
+#define IMC0_HSX_DID 0x2fb0
+#define IMC1_HSX_DID 0x2fd0
+#define IMC0_BDX_DID 0x6fb0
+#define IMC1_BDX_DID 0x6fd0
+#define PCI_VENDOR_INTEL 0x8086
+
 #define Temp_Off 0x150
 
 #define tREFI_Off 0x214
 
 #define Err_cnt_Off 0x104
 
+// defaults of the runtime configuration (config.h)
 #define step_tREFI_inc 0x40
 #define step_tREFI_dec 0x100
 
@@ -42,14 +59,9 @@
 #define MEM_ACCUM_BW_OFFSET_CH2 0x06C
 #define MEM_ACCUM_BW_OFFSET_CH3 0x070
 
-// MAX tREFI 4.5xtREFI at 5'C, min tREFI 2tREFI at 85 'C
-#define temp_slope base_tREFI * 2.5 / 80              // 182, tREFI/40
-#define temp_offset base_tREFI * (4.5 + 2.5 / 80 * 5) // 30030, tREFIx4 + tREFI/8
-
 #define num_channel 4
 
-// use BW stuff
-// #define BW_STUFF //comment to disable bandwith
+// bw-average (and bw-reset floor) policy defaults
 #define average_loop_count 10
 
 #define READ_ABS_MARGIN 50  // MB/s
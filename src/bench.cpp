@@ -0,0 +1,244 @@
+// Memory microbenchmark, see bench.h
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "bench.h"
+
+using namespace std;
+
+#define CHASE_BATCH 1000 // loads per latency sample, a single load is below the clock resolution
+#define CACHE_LINE 64
+
+static const char *kernel_names[NUM_STREAM_KERNELS] = {"copy", "scale", "add", "triad"};
+
+const char *stream_kernel_name(int kernel) { return kernel >= 0 && kernel < NUM_STREAM_KERNELS ? kernel_names[kernel] : "unknown"; }
+
+bool parse_cpu_list(const string &list, vector<int> *cpus) {
+    cpus->clear();
+    const char *p = list.c_str();
+    while (*p && *p != '\n') {
+        char *end = NULL;
+        const long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0)
+            return false;
+        long hi = lo;
+        p = end;
+        if (*p == '-') {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo)
+                return false;
+            p = end;
+        }
+        for (long c = lo; c <= hi; c++)
+            cpus->push_back((int)c);
+        if (*p == ',')
+            p++;
+        else if (*p && *p != '\n')
+            return false;
+    }
+    return !cpus->empty();
+}
+
+vector<vector<int>> numa_cpu_sets() {
+    vector<pair<int, vector<int>>> nodes;
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir == NULL)
+        return vector<vector<int>>();
+    while (struct dirent *e = readdir(dir)) {
+        int node = 0;
+        if (sscanf(e->d_name, "node%d", &node) != 1)
+            continue;
+        ifstream in((string("/sys/devices/system/node/") + e->d_name + "/cpulist").c_str());
+        string list;
+        vector<int> cpus;
+        if (getline(in, list) && parse_cpu_list(list, &cpus))
+            nodes.push_back(make_pair(node, cpus));
+    }
+    closedir(dir);
+    sort(nodes.begin(), nodes.end());
+    vector<vector<int>> sets;
+    for (size_t i = 0; i < nodes.size(); i++)
+        sets.push_back(nodes[i].second);
+    return sets;
+}
+
+void pin_thread(const vector<int> &cpus) {
+    if (cpus.empty())
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); i++)
+        CPU_SET(cpus[i], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+namespace {
+
+class Barrier {
+  public:
+    explicit Barrier(int n) : count(n), waiting(0), generation(0) {}
+
+    void wait() {
+        unique_lock<mutex> lock(m);
+        const uint64_t gen = generation;
+        if (++waiting == count) {
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+        } else {
+            cv.wait(lock, [&] { return gen != generation; });
+        }
+    }
+
+  private:
+    mutex m;
+    condition_variable cv;
+    int count, waiting;
+    uint64_t generation;
+};
+
+typedef chrono::steady_clock Clock;
+
+void *volatile chase_sink; // keeps the chase from being optimized away
+
+// one STREAM thread, seconds[rep * NUM_STREAM_KERNELS + kernel]
+void stream_thread(const BenchOptions &opt, const vector<int> &cpus, Barrier *barrier, vector<double> *seconds) {
+    pin_thread(cpus);
+    const size_t n = max<size_t>(opt.stream_bytes / sizeof(double), 1);
+    // first touch from the pinned thread puts the pages on its node
+    vector<double> a(n, 1.0), b(n, 2.0), c(n, 0.0);
+    const double scalar = 3.0;
+    double *pa = &a[0], *pb = &b[0], *pc = &c[0];
+
+    for (int rep = 0; rep < opt.reps; rep++) {
+        for (int k = 0; k < NUM_STREAM_KERNELS; k++) {
+            barrier->wait();
+            const Clock::time_point start = Clock::now();
+            switch (k) {
+            case STREAM_COPY:
+                for (size_t i = 0; i < n; i++)
+                    pc[i] = pa[i];
+                break;
+            case STREAM_SCALE:
+                for (size_t i = 0; i < n; i++)
+                    pb[i] = scalar * pc[i];
+                break;
+            case STREAM_ADD:
+                for (size_t i = 0; i < n; i++)
+                    pc[i] = pa[i] + pb[i];
+                break;
+            case STREAM_TRIAD:
+                for (size_t i = 0; i < n; i++)
+                    pa[i] = pb[i] + scalar * pc[i];
+                break;
+            }
+            (*seconds)[rep * NUM_STREAM_KERNELS + k] = chrono::duration<double>(Clock::now() - start).count();
+        }
+    }
+    barrier->wait();
+}
+
+// one pointer chase thread, appends the per-load latency of every batch
+void chase_thread(const BenchOptions &opt, const vector<int> &cpus, uint32_t seed, vector<double> *latency_ns, double *total_ns) {
+    pin_thread(cpus);
+    const size_t lines = max<size_t>(opt.chase_bytes / CACHE_LINE, 2);
+    vector<char> buf(lines * CACHE_LINE);
+
+    // single random cycle through all lines (Sattolo), defeats the prefetchers
+    vector<size_t> order(lines);
+    for (size_t i = 0; i < lines; i++)
+        order[i] = i;
+    mt19937_64 rng(seed);
+    for (size_t i = lines - 1; i > 0; i--)
+        swap(order[i], order[uniform_int_distribution<size_t>(0, i - 1)(rng)]);
+    for (size_t i = 0; i < lines; i++)
+        *(void **)&buf[order[i] * CACHE_LINE] = &buf[order[(i + 1) % lines] * CACHE_LINE];
+
+    void *p = &buf[0];
+    for (size_t i = 0; i < lines; i++) // warm up the TLB and bring the cycle in order
+        p = *(void **)p;
+
+    const uint64_t batches = max<uint64_t>(opt.chase_loads / CHASE_BATCH, 1);
+    latency_ns->reserve(batches);
+    const Clock::time_point begin = Clock::now();
+    for (uint64_t b = 0; b < batches; b++) {
+        const Clock::time_point start = Clock::now();
+        for (int i = 0; i < CHASE_BATCH; i++)
+            p = *(void **)p;
+        latency_ns->push_back(chrono::duration<double, nano>(Clock::now() - start).count() / CHASE_BATCH);
+    }
+    *total_ns = chrono::duration<double, nano>(Clock::now() - begin).count() / (batches * CHASE_BATCH);
+    chase_sink = p;
+}
+
+} // namespace
+
+BenchResult run_bench(const BenchOptions &opt) {
+    vector<vector<int>> sets = opt.cpu_sets;
+    if (sets.empty())
+        sets.push_back(vector<int>());
+    BenchResult r;
+
+    // bandwidth, every thread pinned to one CPU of its set
+    vector<vector<int>> thread_cpus;
+    for (size_t s = 0; s < sets.size(); s++) {
+        const int n = opt.threads > 0 ? opt.threads : max<int>(sets[s].size(), 1);
+        for (int t = 0; t < n; t++)
+            thread_cpus.push_back(sets[s].empty() ? vector<int>() : vector<int>(1, sets[s][t % sets[s].size()]));
+    }
+    const int nthreads = thread_cpus.size();
+    vector<vector<double>> seconds(nthreads, vector<double>(opt.reps * NUM_STREAM_KERNELS, 0));
+    {
+        Barrier barrier(nthreads);
+        vector<thread> threads;
+        for (int t = 0; t < nthreads; t++)
+            threads.push_back(thread(stream_thread, cref(opt), cref(thread_cpus[t]), &barrier, &seconds[t]));
+        for (int t = 0; t < nthreads; t++)
+            threads[t].join();
+    }
+    const double words[NUM_STREAM_KERNELS] = {2, 2, 3, 3}; // arrays moved per element
+    const size_t n = max<size_t>(opt.stream_bytes / sizeof(double), 1);
+    for (int k = 0; k < NUM_STREAM_KERNELS; k++) {
+        double best = 0;
+        for (int rep = 0; rep < opt.reps; rep++) {
+            double slowest = 0; // the threads started together, the last one to finish sets the rate
+            for (int t = 0; t < nthreads; t++)
+                slowest = max(slowest, seconds[t][rep * NUM_STREAM_KERNELS + k]);
+            if (rep == 0 || slowest < best)
+                best = slowest;
+        }
+        r.stream_mbps[k] = best > 0 ? words[k] * sizeof(double) * n * nthreads / best / 1e6 : 0;
+    }
+
+    // latency, one idle-system chase per set, run one after the other so they do not load each other
+    vector<double> latency_ns;
+    double mean = 0;
+    for (size_t s = 0; s < sets.size(); s++) {
+        vector<double> samples;
+        double total = 0;
+        thread t(chase_thread, cref(opt), cref(sets[s]), opt.seed + (uint32_t)s, &samples, &total);
+        t.join();
+        latency_ns.insert(latency_ns.end(), samples.begin(), samples.end());
+        mean += total / sets.size();
+    }
+    sort(latency_ns.begin(), latency_ns.end());
+    if (!latency_ns.empty()) {
+        r.latency_p50_ns = latency_ns[(latency_ns.size() - 1) / 2];
+        r.latency_p99_ns = latency_ns[(latency_ns.size() - 1) * 99 / 100];
+    }
+    r.latency_mean_ns = mean;
+    return r;
+}
@@ -0,0 +1,53 @@
+// Memory microbenchmark for dynamicRefresh-bench
+//
+// STREAM style bandwidth kernels (copy, scale, add, triad) on every CPU set
+// given, and a pointer chase latency kernel with one thread per CPU set. A
+// CPU set is normally one NUMA node: its threads are pinned to it and first
+// touch their buffers there, so the traffic stays on that node's channels.
+// Nothing here touches iMC registers, main_bench.cpp sets tREFI around it.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+struct BenchOptions {
+    std::vector<std::vector<int>> cpu_sets; // one entry per node, empty for one unpinned set
+    int threads;         // STREAM threads per set, 0 for one per CPU
+    size_t stream_bytes; // per STREAM thread, per array
+    size_t chase_bytes;  // per latency thread, well above the LLC
+    int reps;            // STREAM repetitions, the best one counts
+    uint64_t chase_loads; // per latency thread
+    uint32_t seed;
+
+    BenchOptions()
+        : threads(0), stream_bytes(64 << 20), chase_bytes(256 << 20), reps(5), chase_loads(20000000), seed(1) {}
+};
+
+enum StreamKernel { STREAM_COPY = 0, STREAM_SCALE, STREAM_ADD, STREAM_TRIAD, NUM_STREAM_KERNELS };
+
+const char *stream_kernel_name(int kernel);
+
+struct BenchResult {
+    double stream_mbps[NUM_STREAM_KERNELS]; // all threads together
+    // load to use latency, from the per-batch averages of the chase
+    double latency_p50_ns, latency_p99_ns, latency_mean_ns;
+
+    BenchResult() : latency_p50_ns(0), latency_p99_ns(0), latency_mean_ns(0) {
+        for (int k = 0; k < NUM_STREAM_KERNELS; k++)
+            stream_mbps[k] = 0;
+    }
+};
+
+// CPUs of every online NUMA node from sysfs, empty if there is no sysfs node info
+std::vector<std::vector<int>> numa_cpu_sets();
+
+// "0-3,8,10-11"
+bool parse_cpu_list(const std::string &list, std::vector<int> *cpus);
+
+// pins the calling thread to cpus, nothing for an empty set
+void pin_thread(const std::vector<int> &cpus);
+
+BenchResult run_bench(const BenchOptions &opt);
@@ -0,0 +1,155 @@
+// Retention characterization, see characterize.h
+
+#include <algorithm>
+
+#include "bench.h"
+#include "characterize.h"
+
+using namespace std;
+
+namespace {
+
+struct SweepState {
+    uint32_t tref_const; // upper bits of the tREFI register
+    uint32_t trefi;
+    uint32_t err_reg;    // previous Err_cnt value
+    uint32_t sweeps;
+    bool settle;         // first dwell of a sweep, errors of the previous one may still come in
+
+    SweepState() : tref_const(0), trefi(0), err_reg(0), sweeps(0), settle(true) {}
+};
+
+// new errors between two Err_cnt values, a cleared counter restarts at 0 and
+// a sticky overflow bit only counts when it comes up
+bool new_errors(uint32_t before, uint32_t now) {
+    const uint32_t ovf = (1u << 31) | (1u << 15);
+    if ((now & ovf) & ~(before & ovf))
+        return true;
+    const uint32_t r1 = (now >> 16) & 0x7fff, pre_r1 = (before >> 16) & 0x7fff;
+    const uint32_t r0 = now & 0x7fff, pre_r0 = before & 0x7fff;
+    return (r1 != pre_r1 && r1 > 0) || (r0 != pre_r0 && r0 > 0);
+}
+
+} // namespace
+
+void run_characterization(RegisterBackend &backend, const CharacterizeOptions &opt, RetentionProfile *profile, CharacterizeStats *stats) {
+    const int channels = backend.numChannels();
+    vector<SweepState> st(channels);
+    CharacterizeStats local;
+    if (stats == NULL)
+        stats = &local;
+    stats->failures.assign(channels, 0);
+    stats->clean.assign(channels, 0);
+
+    const uint64_t start = backend.nowUs();
+    for (int i = 0; i < channels; i++) {
+        uint32_t reg = 0;
+        backend.read32(i, REG_TREFI, &reg);
+        st[i].tref_const = reg & 0xffff8000;
+        st[i].trefi = opt.start_trefi & 0x7fff;
+        backend.read32(i, REG_ERR_CNT, &st[i].err_reg);
+        backend.write32(i, REG_TREFI, st[i].tref_const + st[i].trefi);
+    }
+
+    for (;;) {
+        bool busy = false;
+        for (int i = 0; i < channels; i++)
+            busy |= st[i].sweeps < opt.sweeps;
+        if (!busy || (opt.stop && *opt.stop) || (opt.max_time_us && backend.nowUs() - start >= opt.max_time_us))
+            break;
+
+        backend.sleep(opt.dwell_us);
+        stats->steps++;
+
+        for (int i = 0; i < channels; i++) {
+            SweepState &s = st[i];
+            if (s.sweeps >= opt.sweeps)
+                continue;
+            uint32_t err_reg = 0, temp = 0;
+            backend.read32(i, REG_ERR_CNT, &err_reg);
+            backend.read32(i, REG_TEMP, &temp);
+            const bool failed = new_errors(s.err_reg, err_reg) && !s.settle;
+            s.err_reg = err_reg;
+            if (s.settle) {
+                s.settle = false;
+                continue;
+            }
+
+            if (failed) {
+                profile->record(backend.location(i), temp & 0xff, s.trefi);
+                stats->failures[i]++;
+            } else if (s.trefi + opt.step <= opt.max_trefi) {
+                s.trefi += opt.step;
+                backend.write32(i, REG_TREFI, s.tref_const + s.trefi);
+                continue;
+            } else {
+                stats->clean[i]++;
+            }
+
+            // next sweep, or done with this channel
+            s.sweeps++;
+            s.settle = true;
+            s.trefi = s.sweeps < opt.sweeps ? opt.start_trefi & 0x7fff : opt.base_trefi & 0x7fff;
+            backend.write32(i, REG_TREFI, s.tref_const + s.trefi);
+        }
+    }
+
+    for (int i = 0; i < channels; i++)
+        backend.write32(i, REG_TREFI, st[i].tref_const + (opt.base_trefi & 0x7fff));
+}
+
+PatternLoad::PatternLoad(size_t bytes, const vector<vector<int>> &cpu_sets) : words(max<size_t>(bytes / sizeof(uint64_t), 1)), running(false) {
+    for (size_t i = 0; i < max<size_t>(cpu_sets.size(), 1); i++) {
+        workers.push_back(unique_ptr<Worker>(new Worker()));
+        if (i < cpu_sets.size())
+            workers.back()->cpus = cpu_sets[i];
+    }
+}
+
+PatternLoad::~PatternLoad() { stop(); }
+
+void PatternLoad::start() {
+    if (running.exchange(true))
+        return;
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i]->thread = thread(&PatternLoad::run, this, workers[i].get());
+}
+
+void PatternLoad::stop() {
+    if (!running.exchange(false))
+        return;
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i]->thread.join();
+}
+
+uint64_t PatternLoad::passes() const {
+    uint64_t n = 0;
+    for (size_t i = 0; i < workers.size(); i++)
+        n += workers[i]->npasses;
+    return n;
+}
+
+uint64_t PatternLoad::mismatches() const {
+    uint64_t n = 0;
+    for (size_t i = 0; i < workers.size(); i++)
+        n += workers[i]->nmismatches;
+    return n;
+}
+
+void PatternLoad::run(Worker *w) {
+    // pinned before the buffer is first touched, so its pages land on the node
+    pin_thread(w->cpus);
+    vector<uint64_t> buf(words);
+    volatile uint64_t *p = &buf[0];
+    const size_t n = buf.size();
+    while (running.load(memory_order_relaxed)) {
+        const uint64_t pattern = w->npasses.load(memory_order_relaxed) & 1 ? 0xaaaaaaaaaaaaaaaaull : 0x5555555555555555ull;
+        for (size_t i = 0; i < n; i++)
+            p[i] = pattern;
+        uint64_t bad = 0;
+        for (size_t i = 0; i < n; i++)
+            bad += p[i] != pattern;
+        w->nmismatches.fetch_add(bad, memory_order_relaxed);
+        w->npasses.fetch_add(1, memory_order_relaxed);
+    }
+}
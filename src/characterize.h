@@ -0,0 +1,87 @@
+// Retention characterization
+//
+// Maintenance window / canary mode: instead of controlling tREFI, sweep it up
+// on every channel from start_trefi in steps of step, holding each step for
+// dwell_us, until the channel reports new correctable errors. The tREFI of
+// that step is the channel's failure point at the current temperature and
+// goes into the RetentionProfile; the channel then drops back to start_trefi
+// for the next sweep. Channels sweep independently. base_trefi is written
+// back to every channel when done.
+//
+// The error counters only see cells that are read, so the sweep should run
+// under a known memory pattern (PatternLoad) rather than whatever the machine
+// happens to do.
+
+#pragma once
+
+#include <signal.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "address.h"
+#include "profile.h"
+#include "register_backend.h"
+
+struct CharacterizeOptions {
+    uint32_t base_trefi;  // written back at the end
+    uint32_t start_trefi; // every sweep starts here
+    uint32_t step;
+    uint32_t max_trefi;   // a sweep that reaches it without errors ends without a failure point
+    uint64_t dwell_us;    // time at each step
+    uint32_t sweeps;      // per channel
+    uint64_t max_time_us; // backend time, 0 for no limit
+    const volatile sig_atomic_t *stop; // checked between steps, may be NULL
+
+    CharacterizeOptions()
+        : base_trefi(base_tREFI), start_trefi(base_tREFI), step(step_tREFI_inc), max_trefi(0x7fff), dwell_us(2000000), sweeps(3), max_time_us(0),
+          stop(NULL) {}
+};
+
+struct CharacterizeStats {
+    uint64_t steps;
+    std::vector<uint32_t> failures; // per channel, sweeps that found a failure point
+    std::vector<uint32_t> clean;    // per channel, sweeps that reached max_trefi
+
+    CharacterizeStats() : steps(0) {}
+};
+
+void run_characterization(RegisterBackend &backend, const CharacterizeOptions &opt, RetentionProfile *profile, CharacterizeStats *stats);
+
+// Background threads that keep writing and reading back alternating
+// 0x55/0xaa patterns over a buffer, so every cell of it is exercised
+// between error counter samples. There is one thread per CPU set (normally
+// one per NUMA node, see numa_cpu_sets()), pinned to it and with its own
+// buffer of bytes first touched there, so every node's channels see the
+// pattern; no CPU sets run one unpinned thread. Mismatches are counted, they
+// mean an uncorrected error made it through.
+class PatternLoad {
+  public:
+    PatternLoad(size_t bytes, const std::vector<std::vector<int>> &cpu_sets);
+    ~PatternLoad();
+
+    void start();
+    void stop();
+
+    // over all threads
+    uint64_t passes() const;
+    uint64_t mismatches() const;
+
+  private:
+    struct Worker {
+        std::vector<int> cpus;
+        std::thread thread;
+        std::atomic<uint64_t> npasses, nmismatches;
+
+        Worker() : npasses(0), nmismatches(0) {}
+    };
+
+    void run(Worker *w);
+
+    size_t words; // per thread
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> running;
+};
@@ -0,0 +1,123 @@
+// Controller checkpoint, see checkpoint.h
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "checkpoint.h"
+#include "register_backend.h"
+
+#define CHECKPOINT_VERSION 2
+
+bool Checkpoint::save(const std::string &path, std::string *err) const {
+    const std::string tmp = path + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "w");
+    if (!out) {
+        *err = "can not write " + tmp + ": " + strerror(errno);
+        return false;
+    }
+    fprintf(out, "# dynamicRefresh checkpoint %d\n", CHECKPOINT_VERSION);
+    fprintf(out, "time %lld\n", (long long)written);
+    fprintf(out, "# socket imc channel trefi temp dram_mts base_trefi trfc\n");
+    for (size_t i = 0; i < channels.size(); i++) {
+        const ChannelCheckpoint &c = channels[i];
+        fprintf(out, "%u %u %u %u %u %u %u %u\n", c.socket, c.imc, c.channel, c.trefi, c.temp, c.dram_mts, c.base_trefi, c.trfc);
+    }
+    // on disk before the rename, a crash must not leave an empty or partial
+    // file under path
+    const bool ok = fflush(out) == 0 && fsync(fileno(out)) == 0;
+    if (fclose(out) != 0 || !ok) {
+        *err = "can not write " + tmp + ": " + strerror(errno);
+        unlink(tmp.c_str());
+        return false;
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        *err = "can not rename " + tmp + " to " + path + ": " + strerror(errno);
+        return false;
+    }
+    // and the rename itself
+    const size_t slash = path.rfind('/');
+    const std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    const int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    return true;
+}
+
+bool Checkpoint::load(const std::string &path, std::string *err) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        *err = "can not open " + path;
+        return false;
+    }
+    std::string line;
+    if (!std::getline(in, line) || line.find("# dynamicRefresh checkpoint ") != 0 ||
+        atoi(line.c_str() + strlen("# dynamicRefresh checkpoint ")) != CHECKPOINT_VERSION) {
+        *err = path + ": not a version " + std::to_string(CHECKPOINT_VERSION) + " checkpoint";
+        return false;
+    }
+
+    Checkpoint c;
+    for (int n = 2; std::getline(in, line); n++) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        if (line.compare(0, 5, "time ") == 0) {
+            std::string key;
+            long long t = 0;
+            fields >> key >> t;
+            c.written = t;
+            continue;
+        }
+        ChannelCheckpoint k;
+        fields >> k.socket >> k.imc >> k.channel >> k.trefi >> k.temp >> k.dram_mts >> k.base_trefi >> k.trfc;
+        if (!fields || k.trefi == 0 || k.trefi > 0x7fff || k.temp > 255) {
+            *err = path + ":" + std::to_string(n) + ": expected socket imc channel trefi temp dram_mts base_trefi trfc";
+            return false;
+        }
+        c.channels.push_back(k);
+    }
+    *this = c;
+    return true;
+}
+
+uint32_t checkpoint_dram_mts(const Checkpoint &ckpt) {
+    for (size_t i = 0; i < ckpt.channels.size(); i++) {
+        if (ckpt.channels[i].dram_mts)
+            return ckpt.channels[i].dram_mts;
+    }
+    return 0;
+}
+
+bool checkpoint_start_trefi(const Checkpoint &ckpt, RegisterBackend &backend, const CheckpointMatch &match, std::vector<uint32_t> *start, std::string *err) {
+    start->assign(backend.numChannels(), 0);
+    const time_t now = time(NULL);
+    if (match.max_age_s && (ckpt.written > now || (uint64_t)(now - ckpt.written) > match.max_age_s)) {
+        *err = "written " + std::to_string((long long)(now - ckpt.written)) + " s ago, more than " + std::to_string(match.max_age_s) + " s";
+        return false;
+    }
+    for (int i = 0; i < backend.numChannels(); i++) {
+        const ChannelLocation &loc = backend.location(i);
+        for (size_t k = 0; k < ckpt.channels.size(); k++) {
+            const ChannelCheckpoint &c = ckpt.channels[k];
+            if (c.socket != loc.socket || c.imc != loc.imc || c.channel != loc.channel)
+                continue;
+            uint32_t temp = 0, trefi_reg = 0;
+            backend.read32(i, REG_TEMP, &temp);
+            backend.read32(i, REG_TREFI, &trefi_reg);
+            const bool same_hw = c.dram_mts == match.dram_mts && c.base_trefi == match.base_trefi && c.trfc == ((trefi_reg >> 15) & 0x1ff);
+            if (same_hw && (temp & 0xff) <= c.temp + match.max_degc)
+                (*start)[i] = c.trefi;
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+// Controller checkpoint
+//
+// The controller saves the last tREFI each channel ran without new errors,
+// and the temperature it ran at, every checkpoint_us. A restarted daemon
+// resumes each channel from there instead of base_tREFI, unless the channel
+// is now more than max_degc hotter than at the checkpoint: retention halves
+// every ~10 degC, so the saved interval is only known to be safe at that
+// temperature or colder.
+//
+// An interval is only known to be safe on the hardware it ran on, so every
+// entry records the DRAM clock, base tREFI and tRFC field of its channel and
+// is skipped when the channel now runs different ones (a DIMM swap or a
+// clock change). A checkpoint older than max_age_s is not resumed at all.
+//
+// Text file, replaced atomically (write to path.tmp, fsync, rename):
+//   # dynamicRefresh checkpoint 2
+//   time <unix seconds>
+//   socket imc channel trefi temp dram_mts base_trefi trfc
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "topology.h"
+
+class RegisterBackend;
+
+struct ChannelCheckpoint {
+    uint32_t socket, imc, channel;
+    uint32_t trefi; // last tREFI without new errors
+    uint32_t temp;  // degC while running it
+    uint32_t dram_mts, base_trefi, trfc; // the hardware it ran on, trfc is the register field
+};
+
+struct Checkpoint {
+    time_t written;
+    std::vector<ChannelCheckpoint> channels;
+
+    Checkpoint() : written(0) {}
+
+    bool save(const std::string &path, std::string *err) const;
+    bool load(const std::string &path, std::string *err);
+};
+
+// the DRAM clock the checkpoint was written at, 0 when no entry has one
+uint32_t checkpoint_dram_mts(const Checkpoint &ckpt);
+
+// what a checkpoint has to match to be resumed
+struct CheckpointMatch {
+    uint32_t max_degc;  // hotter than this above the checkpoint is not resumed
+    uint64_t max_age_s; // older checkpoints are not resumed, 0 for any age
+    uint32_t dram_mts, base_trefi;
+};
+
+// per-channel resume tREFI at the current temperatures, 0 for a channel that
+// is missing from the checkpoint, ran on other hardware or is too much hotter
+// now; false with the reason when the whole checkpoint is too old
+bool checkpoint_start_trefi(const Checkpoint &ckpt, RegisterBackend &backend, const CheckpointMatch &match, std::vector<uint32_t> *start, std::string *err);
@@ -0,0 +1,417 @@
+// Runtime configuration, see config.h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "address.h"
+#include "checkpoint.h"
+#include "config.h"
+#include "nodes.h"
+#include "profile.h"
+#include "timing.h"
+
+RefreshConfig::RefreshConfig() : policy("temp-slope"), dram_mts(1866), trfc_ns(350), profile_margin(0.1), checkpoint_us(60000000), checkpoint_max_degc(3), checkpoint_max_age_s(86400), target("balanced") {
+    const ControllerOptions defaults;
+    const CharacterizeOptions sweep;
+    base_trefi = defaults.base_trefi;
+    loop_sleep_us = defaults.loop_sleep_us;
+    loop_sleep_min_us = defaults.loop_sleep_min_us;
+    loop_sleep_max_us = defaults.loop_sleep_max_us;
+    temp_step = defaults.temp_step;
+    deadline_miss_us = defaults.deadline_miss_us;
+    write_band_up = defaults.write_band_up;
+    write_band_down = defaults.write_band_down;
+    sweep_step = sweep.step;
+    sweep_count = sweep.sweeps;
+    sweep_max_trefi = sweep.max_trefi;
+    sweep_dwell_us = sweep.dwell_us;
+}
+
+static bool valid_target(const std::string &t) { return t == "bandwidth" || t == "balanced" || t == "safe"; }
+
+static std::string trim(const std::string &s) {
+    const size_t b = s.find_first_not_of(" \t\r");
+    if (b == std::string::npos)
+        return "";
+    return s.substr(b, s.find_last_not_of(" \t\r") - b + 1);
+}
+
+// the numeric controller keys and the largest value their field holds: the
+// 15 bit tREFI field, UINT32_MAX for the other 32 bit fields and a sanity
+// bound for the 64 bit and floating point ones
+static const struct {
+    const char *name;
+    double max;
+} controller_keys[] = {
+    {"base_trefi", 0x7fff}, {"loop_sleep_us", 1e12}, {"loop_sleep_min_us", 1e12}, {"loop_sleep_max_us", 1e12},
+    {"temp_step", UINT32_MAX}, {"deadline_miss_us", 1e12}, {"write_band_up", 0x7fff}, {"write_band_down", 0x7fff},
+    {"dram_mts", 1e12}, {"trfc_ns", 1e12}, {"profile_margin", 1e12}, {"checkpoint_us", 1e12},
+    {"checkpoint_max_degc", UINT32_MAX}, {"checkpoint_max_age_s", 1e12}, {"sweep_step", 0x7fff}, {"sweep_dwell_us", 1e12},
+    {"sweep_count", UINT32_MAX}, {"sweep_max_trefi", 0x7fff},
+};
+
+bool set_config(RefreshConfig *cfg, const std::string &assignment, const std::string &origin, std::string *err) {
+    const size_t eq = assignment.find('=');
+    if (eq == std::string::npos) {
+        *err = origin + ": expected key=value, got \"" + assignment + "\"";
+        return false;
+    }
+    const std::string key = trim(assignment.substr(0, eq));
+    const std::string value = trim(assignment.substr(eq + 1));
+    if (key == "policy") {
+        cfg->policy = value;
+        return true;
+    }
+    if (key == "profile") {
+        cfg->profile = value;
+        return true;
+    }
+    if (key == "checkpoint") {
+        cfg->checkpoint = value;
+        return true;
+    }
+
+    // S<socket>.key or S<socket>.MC<imc>.key
+    std::string scope, name = key;
+    const size_t dot = key.rfind('.');
+    if (dot != std::string::npos) {
+        scope = key.substr(0, dot);
+        name = key.substr(dot + 1);
+        unsigned sk = 0, mc = 0;
+        char canon[32] = "";
+        if (sscanf(scope.c_str(), "S%u.MC%u", &sk, &mc) == 2)
+            snprintf(canon, sizeof(canon), "S%u.MC%u", sk, mc);
+        else if (sscanf(scope.c_str(), "S%u", &sk) == 1)
+            snprintf(canon, sizeof(canon), "S%u", sk);
+        if (scope != canon || name.empty()) {
+            *err = origin + ": " + key + " is not S<socket>.key or S<socket>.MC<imc>.key";
+            return false;
+        }
+    }
+    NodeScope *node = NULL;
+    if (!scope.empty()) {
+        for (size_t i = 0; i < cfg->nodes.size() && !node; i++) {
+            if (cfg->nodes[i].scope == scope)
+                node = &cfg->nodes[i];
+        }
+        if (!node) {
+            cfg->nodes.push_back(NodeScope());
+            node = &cfg->nodes.back();
+            node->scope = scope;
+        }
+    }
+    if (node && name == "policy") {
+        node->policy = value;
+        return true;
+    }
+    if (node && (name == "profile" || name == "checkpoint")) {
+        *err = origin + ": " + name + " can not be set per node";
+        return false;
+    }
+    if (name == "target") {
+        if (!valid_target(value)) {
+            *err = origin + ": " + key + " = " + value + ", expected bandwidth, balanced or safe";
+            return false;
+        }
+        (node ? node->target : cfg->target) = value;
+        return true;
+    }
+
+    char *end = NULL;
+    const double v = strtod(value.c_str(), &end);
+    if (key.empty() || value.empty() || *end != '\0') {
+        *err = origin + ": expected a number for " + key + ", got \"" + value + "\"";
+        return false;
+    }
+    double max = -1;
+    for (size_t i = 0; i < sizeof(controller_keys) / sizeof(controller_keys[0]); i++) {
+        if (name == controller_keys[i].name)
+            max = controller_keys[i].max;
+    }
+    const bool controller_key = max >= 0;
+    if (node) {
+        if (controller_key) {
+            *err = origin + ": " + name + " is a controller key, only policy parameters and target can be set per node";
+            return false;
+        }
+        ConfigParam p;
+        p.key = name;
+        p.value = v;
+        p.origin = origin;
+        node->params.push_back(p);
+        return true;
+    }
+    // checked before the conversion, an out of range double does not convert
+    if (controller_key && (v < 0 || v > max)) {
+        *err = origin + ": " + key + " = " + value + " is out of range";
+        return false;
+    }
+    if (key == "base_trefi")
+        cfg->base_trefi = v;
+    else if (key == "loop_sleep_us")
+        cfg->loop_sleep_us = v;
+    else if (key == "loop_sleep_min_us")
+        cfg->loop_sleep_min_us = v;
+    else if (key == "loop_sleep_max_us")
+        cfg->loop_sleep_max_us = v;
+    else if (key == "temp_step")
+        cfg->temp_step = v;
+    else if (key == "deadline_miss_us")
+        cfg->deadline_miss_us = v;
+    else if (key == "write_band_up")
+        cfg->write_band_up = v;
+    else if (key == "write_band_down")
+        cfg->write_band_down = v;
+    else if (key == "dram_mts")
+        cfg->dram_mts = v;
+    else if (key == "trfc_ns")
+        cfg->trfc_ns = v;
+    else if (key == "profile_margin")
+        cfg->profile_margin = v;
+    else if (key == "checkpoint_us")
+        cfg->checkpoint_us = v;
+    else if (key == "checkpoint_max_degc")
+        cfg->checkpoint_max_degc = v;
+    else if (key == "checkpoint_max_age_s")
+        cfg->checkpoint_max_age_s = v;
+    else if (key == "sweep_step")
+        cfg->sweep_step = v;
+    else if (key == "sweep_dwell_us")
+        cfg->sweep_dwell_us = v;
+    else if (key == "sweep_count")
+        cfg->sweep_count = v;
+    else if (key == "sweep_max_trefi")
+        cfg->sweep_max_trefi = v;
+    else {
+        ConfigParam p;
+        p.key = key;
+        p.value = v;
+        p.origin = origin;
+        cfg->policy_params.push_back(p);
+    }
+    return true;
+}
+
+bool load_config(const std::string &path, const std::vector<std::string> &overrides, RefreshConfig *cfg, std::string *err, const RefreshConfig *defaults) {
+    RefreshConfig c = defaults ? *defaults : RefreshConfig();
+
+    if (!path.empty()) {
+        std::ifstream in(path.c_str());
+        if (!in) {
+            *err = "can not open " + path;
+            return false;
+        }
+        std::string line;
+        for (int n = 1; std::getline(in, line); n++) {
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty())
+                continue;
+            std::ostringstream origin;
+            origin << path << ":" << n;
+            if (!set_config(&c, line, origin.str(), err))
+                return false;
+        }
+    }
+    for (size_t i = 0; i < overrides.size(); i++) {
+        if (!set_config(&c, overrides[i], "command line", err))
+            return false;
+    }
+
+    if (c.base_trefi < 1 || c.base_trefi > 0x7fff) {
+        *err = "base_trefi has to fit the 15 bit tREFI field";
+        return false;
+    }
+    if (c.loop_sleep_min_us < 1000 || c.loop_sleep_min_us > c.loop_sleep_us || c.loop_sleep_us > c.loop_sleep_max_us) {
+        *err = "need 1000 <= loop_sleep_min_us <= loop_sleep_us <= loop_sleep_max_us";
+        return false;
+    }
+    if (c.temp_step > 255) {
+        *err = "temp_step is above 255 degC";
+        return false;
+    }
+    if (c.write_band_up > 0x7fff || c.write_band_down > 0x7fff) {
+        *err = "write_band_up and write_band_down have to fit the 15 bit tREFI field";
+        return false;
+    }
+    if (c.dram_mts < 100 || c.trfc_ns > 10000) {
+        *err = "need dram_mts >= 100 and trfc_ns <= 10000";
+        return false;
+    }
+    if (c.profile_margin >= 1) {
+        *err = "profile_margin has to be below 1";
+        return false;
+    }
+    if (c.checkpoint_us && c.checkpoint_us < 1000000) {
+        *err = "checkpoint_us has to be 0 (only at exit) or at least a second";
+        return false;
+    }
+    if (c.checkpoint_max_degc > 255) {
+        *err = "checkpoint_max_degc is above 255 degC";
+        return false;
+    }
+    if (c.sweep_step < 1 || c.sweep_max_trefi > 0x7fff || c.sweep_dwell_us < 1000) {
+        *err = "need sweep_step >= 1, sweep_max_trefi <= 0x7fff and sweep_dwell_us >= 1000";
+        return false;
+    }
+    *cfg = c;
+    return true;
+}
+
+// aggressiveness presets, scale the defaults of the parameters a policy has:
+// bandwidth climbs twice as fast and backs off half as far, safe climbs at
+// half the speed, backs off twice as far and keeps a quarter below the ceiling
+static void apply_target(RefreshPolicy *policy, const std::string &target) {
+    static const struct {
+        const char *target, *key;
+        double scale;
+    } presets[] = {
+        {"bandwidth", "step_inc", 2},     {"bandwidth", "step_dec", 0.5},  {"safe", "step_inc", 0.5},  {"safe", "step_dec", 2},
+        {"safe", "temp_slope", 0.75},     {"safe", "temp_offset", 0.75},   {"safe", "max_trefi", 0.75},
+    };
+    const std::vector<PolicyParam> &params = policy->parameters();
+    for (size_t i = 0; i < sizeof(presets) / sizeof(presets[0]); i++) {
+        if (target != presets[i].target)
+            continue;
+        for (size_t j = 0; j < params.size(); j++) {
+            if (presets[i].key == std::string(params[j].key))
+                *params[j].value = std::min(std::max(*params[j].value * presets[i].scale, params[j].min), params[j].max);
+        }
+    }
+}
+
+static bool set_params(RefreshPolicy *policy, const std::string &policy_name, const std::vector<ConfigParam> &params, bool strict, std::string *err) {
+    for (size_t i = 0; i < params.size(); i++) {
+        const ConfigParam &p = params[i];
+        if (!policy->setParam(p.key, p.value) && strict) {
+            std::ostringstream msg;
+            msg << p.origin << ": " << policy_name << " has no parameter " << p.key << ", it takes\n";
+            policy->printParams(msg);
+            *err = msg.str();
+            err->erase(err->size() - 1); // callers add the newline
+            return false;
+        }
+    }
+    return true;
+}
+
+RefreshPolicy *make_scoped_policy(const RefreshConfig &cfg, const std::vector<const NodeScope *> &scopes, std::string *err) {
+    std::string name = cfg.policy, target = cfg.target, label = "all channels";
+    for (size_t i = 0; i < scopes.size(); i++) {
+        if (!scopes[i]->policy.empty())
+            name = scopes[i]->policy;
+        if (!scopes[i]->target.empty())
+            target = scopes[i]->target;
+        label = scopes[i]->scope;
+    }
+    std::unique_ptr<RefreshPolicy> policy(make_policy(name, cfg.base_trefi));
+    if (!policy) {
+        *err = label + ": unknown policy " + name + ", one of " + policy_names();
+        return NULL;
+    }
+    apply_target(policy.get(), target);
+    // a node running another policy skips the global keys it does not have
+    if (!set_params(policy.get(), name, cfg.policy_params, name == cfg.policy, err))
+        return NULL;
+    for (size_t i = 0; i < scopes.size(); i++) {
+        if (!set_params(policy.get(), name, scopes[i]->params, true, err))
+            return NULL;
+    }
+    std::string why;
+    if (!policy->validate(&why)) {
+        *err = (scopes.empty() ? name : label + " " + name) + ": " + why;
+        return NULL;
+    }
+    return policy.release();
+}
+
+RefreshPolicy *make_policy(const RefreshConfig &cfg, std::string *err) {
+    if (cfg.nodes.empty())
+        return make_scoped_policy(cfg, std::vector<const NodeScope *>(), err);
+    std::unique_ptr<NodePolicy> nodes(new NodePolicy(cfg));
+    if (!nodes->check(err))
+        return NULL;
+    return nodes.release();
+}
+
+void apply_config(const RefreshConfig &cfg, ControllerOptions *opt) {
+    opt->base_trefi = cfg.base_trefi;
+    opt->dram_mts = cfg.dram_mts;
+    opt->loop_sleep_us = cfg.loop_sleep_us;
+    opt->loop_sleep_min_us = cfg.loop_sleep_min_us;
+    opt->loop_sleep_max_us = cfg.loop_sleep_max_us;
+    opt->temp_step = cfg.temp_step;
+    opt->deadline_miss_us = cfg.deadline_miss_us;
+    opt->write_band_up = cfg.write_band_up;
+    opt->write_band_down = cfg.write_band_down;
+    opt->checkpoint_us = cfg.checkpoint_us;
+}
+
+void apply_config(const RefreshConfig &cfg, CharacterizeOptions *opt) {
+    opt->base_trefi = cfg.base_trefi;
+    opt->start_trefi = cfg.base_trefi;
+    opt->step = cfg.sweep_step;
+    opt->max_trefi = cfg.sweep_max_trefi;
+    opt->dwell_us = cfg.sweep_dwell_us;
+    opt->sweeps = cfg.sweep_count;
+}
+
+void apply_config(const RefreshConfig &cfg, DramTiming *timing) {
+    timing->tck_ns = dram_tck_ns(cfg.dram_mts);
+    timing->trfc_ck = cfg.trfc_ns / timing->tck_ns + 0.5;
+}
+
+bool apply_profile(const RefreshConfig &cfg, RegisterBackend &backend, ControllerOptions *opt, std::string *err) {
+    opt->start_trefi.clear();
+    if (cfg.profile.empty())
+        return true;
+    RetentionProfile profile;
+    if (!profile.load(cfg.profile, err))
+        return false;
+    opt->start_trefi = profile_start_trefi(profile, backend, cfg.profile_margin);
+    return true;
+}
+
+bool reload_config(const std::string &path, const std::vector<std::string> &overrides, ControllerOptions *opt,
+                   std::unique_ptr<RefreshPolicy> *policy, std::string *err, const RefreshConfig *defaults) {
+    RefreshConfig cfg;
+    if (!load_config(path, overrides, &cfg, err, defaults))
+        return false;
+    std::unique_ptr<RefreshPolicy> fresh(make_policy(cfg, err));
+    if (!fresh)
+        return false;
+
+    apply_config(cfg, opt);
+    if (!*policy || !(*policy)->retune(*fresh))
+        *policy = std::move(fresh);
+    opt->policy = policy->get();
+    return true;
+}
+
+bool apply_checkpoint(const RefreshConfig &cfg, RegisterBackend &backend, ControllerOptions *opt, int *resumed, std::string *err) {
+    *resumed = 0;
+    if (cfg.checkpoint.empty() || access(cfg.checkpoint.c_str(), F_OK) != 0)
+        return true;
+    Checkpoint ckpt;
+    if (!ckpt.load(cfg.checkpoint, err))
+        return false;
+    const CheckpointMatch match = {cfg.checkpoint_max_degc, cfg.checkpoint_max_age_s, (uint32_t)cfg.dram_mts, cfg.base_trefi};
+    std::vector<uint32_t> start;
+    if (!checkpoint_start_trefi(ckpt, backend, match, &start, err)) {
+        *err = cfg.checkpoint + ": " + *err;
+        return false;
+    }
+    opt->start_trefi.resize(start.size(), 0);
+    for (size_t i = 0; i < start.size(); i++) {
+        if (start[i]) {
+            opt->start_trefi[i] = start[i];
+            (*resumed)++;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,123 @@
+// Runtime configuration
+//
+// The tuning that used to be compiled in from address.h, read from a file of
+// "key = value" lines ('#' starts a comment) and -P key=value command line
+// overrides, in that order. Controller keys:
+//   policy             refresh policy name
+//   base_trefi         tREFI written at startup
+//   loop_sleep_us      sample period of a channel that is still climbing
+//   loop_sleep_min_us  sample period after an error or a temperature step
+//   loop_sleep_max_us  sample period ceiling while at the tREFI limit
+//   temp_step          degC change that counts as a temperature step
+//   deadline_miss_us   lateness of a tick against its deadline that counts as a miss
+//   write_band_up      tREFI increase too small to be written
+//   write_band_down    tREFI decrease too small to be written, errors always are
+//   dram_mts           DRAM transfer rate the refresh accounting assumes,
+//                      discovered by the daemon (timing.h) like base_trefi
+//   trfc_ns            tRFC of channels whose register has no tRFC field
+//   profile            retention profile (profile.h) to start the channels from
+//   profile_margin     fraction below the profiled failure point to start at
+//   checkpoint         file the controller state is saved to and resumed from,
+//                      like profile only read at startup
+//   checkpoint_us      time between two checkpoints
+//   checkpoint_max_degc  how much hotter a channel may be than at the checkpoint to resume
+//   checkpoint_max_age_s  older checkpoints are not resumed, 0 for any age
+//   sweep_step         characterization: tREFI step of a sweep
+//   sweep_dwell_us     characterization: time at each step
+//   sweep_count        characterization: sweeps per channel
+//   sweep_max_trefi    characterization: highest tREFI a sweep goes to
+// every other key is a parameter of the chosen policy. The address.h values
+// remain the defaults.
+//
+// Per NUMA node tuning (nodes.h): "target = bandwidth|balanced|safe" picks an
+// aggressiveness preset for the policy parameters, and a key prefixed with a
+// node, S<socket> or S<socket>.MC<imc>, only applies to the channels of that
+// node, e.g. "S1.target = safe", "S1.policy = pid" or "S0.MC1.step_inc = 128".
+// The most specific setting wins, explicit parameters win over the preset.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "accounting.h"
+#include "characterize.h"
+#include "controller.h"
+#include "policy.h"
+
+struct ConfigParam {
+    std::string key;
+    double value;
+    std::string origin; // "file:line" or "command line", for error messages
+};
+
+// settings of one node, scope is "S<socket>" or "S<socket>.MC<imc>"
+struct NodeScope {
+    std::string scope;
+    std::string policy; // empty to inherit
+    std::string target; // empty to inherit
+    std::vector<ConfigParam> params;
+};
+
+struct RefreshConfig {
+    std::string policy;
+    uint32_t base_trefi;
+    uint64_t loop_sleep_us, loop_sleep_min_us, loop_sleep_max_us;
+    uint32_t temp_step;
+    uint64_t deadline_miss_us;
+    uint32_t write_band_up, write_band_down;
+    double dram_mts, trfc_ns; // refresh accounting
+    std::string profile; // empty for none
+    double profile_margin;
+    std::string checkpoint; // empty for none
+    uint64_t checkpoint_us;
+    uint32_t checkpoint_max_degc;
+    uint64_t checkpoint_max_age_s;
+    uint32_t sweep_step, sweep_count, sweep_max_trefi;
+    uint64_t sweep_dwell_us;
+    std::vector<ConfigParam> policy_params; // applied in order, later ones win
+    std::string target;                     // preset of every channel, "balanced" by default
+    std::vector<NodeScope> nodes;           // in order of first appearance
+
+    RefreshConfig();
+};
+
+// key=value, origin is used in error messages
+bool set_config(RefreshConfig *cfg, const std::string &assignment, const std::string &origin, std::string *err);
+
+// defaults (the built-in ones when NULL, e.g. discovered ones from
+// timing.h), then the file (skipped if path is empty), then the overrides;
+// validates the controller keys
+bool load_config(const std::string &path, const std::vector<std::string> &overrides, RefreshConfig *cfg, std::string *err,
+                 const RefreshConfig *defaults = NULL);
+
+// the configured policy with its parameters applied and validated, a
+// NodePolicy when nodes are configured, NULL on error
+RefreshPolicy *make_policy(const RefreshConfig &cfg, std::string *err);
+
+// the policy of the channels the scopes apply to (least specific first): the
+// policy and preset of the most specific scope that sets them, the global
+// parameters, then the scope ones
+RefreshPolicy *make_scoped_policy(const RefreshConfig &cfg, const std::vector<const NodeScope *> &scopes, std::string *err);
+
+void apply_config(const RefreshConfig &cfg, ControllerOptions *opt);
+void apply_config(const RefreshConfig &cfg, CharacterizeOptions *opt);
+void apply_config(const RefreshConfig &cfg, DramTiming *timing);
+
+// per-channel start tREFI from cfg.profile at the current temperatures, the
+// profile is only read at startup
+bool apply_profile(const RefreshConfig &cfg, RegisterBackend &backend, ControllerOptions *opt, std::string *err);
+
+// resume channels from cfg.checkpoint on top of the profile start, a missing
+// file is a first start and not an error; *resumed counts the channels
+bool apply_checkpoint(const RefreshConfig &cfg, RegisterBackend &backend, ControllerOptions *opt, int *resumed, std::string *err);
+
+// SIGHUP handling: load path and overrides again and apply them to the running
+// controller. A policy that can retune() to the new one keeps its per-channel
+// history and only takes the new parameters; a different one replaces
+// *policy. Nothing changes on error.
+bool reload_config(const std::string &path, const std::vector<std::string> &overrides, ControllerOptions *opt,
+                   std::unique_ptr<RefreshPolicy> *policy, std::string *err, const RefreshConfig *defaults = NULL);
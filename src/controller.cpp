@@ -0,0 +1,402 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2009-2020, Intel Corporation
+
+// Based on Code by IntelPCM
+// Modified from Intel by Chihun Song: 12-09-2022
+// Updated by Gregory Jun: 12-10-2022
+
+#include <algorithm>
+#include <vector>
+
+#include "accounting.h"
+#include "address.h"
+#include "checkpoint.h"
+#include "controller.h"
+#include "metrics.h"
+#include "overhead.h"
+#include "policy.h"
+#include "scheduler.h"
+#include "telemetry.h"
+
+using namespace std;
+
+// decode the registers of one channel into its lane of the tick
+static void sample_channel(const ControllerOptions &opt, uint64_t time_us, const ChannelRegs &regs, ChannelState &st, ChannelSample &s) {
+    s.time_us = time_us;
+    s.temp = regs.temp & 0xff;
+
+    st.temp_step = st.samples && (s.temp > st.last_temp + opt.temp_step || s.temp + opt.temp_step < st.last_temp);
+    st.last_temp = s.temp;
+
+    s.ovf_r1 = (regs.err_cnt >> 31) & 0x1;
+    s.err_r1 = (regs.err_cnt >> 16) & 0x7fff;
+    s.ovf_r0 = (regs.err_cnt >> 15) & 0x1;
+    s.err_r0 = regs.err_cnt & 0x00007fff;
+    st.err_r1 = s.err_r1;
+    st.err_r0 = s.err_r0;
+
+    // the policy climbs on from its own choice while the register holds what
+    // the controller last wrote, a write inside the bands lags behind it;
+    // errors and the safe tREFI always refer to the register
+    s.trefi = regs.trefi & 0x7fff;
+    s.target = regs.trefi == st.written && st.target ? st.target : s.trefi;
+}
+
+// whether the decision has to reach the register
+static bool needs_write(const ControllerOptions &opt, const ChannelState &st, const Decision &d, uint32_t value) {
+    if (value == st.written)
+        return false;
+    if (!st.written || (value & 0xffff8000) != (st.written & 0xffff8000) || d.reason == REASON_ERR || d.reason == REASON_ERR_CLEAR)
+        return true;
+    const uint32_t cur = st.written & 0x7fff, next = value & 0x7fff;
+    return next > cur ? next - cur > opt.write_band_up : cur - next > opt.write_band_down;
+}
+
+// the channel runs at the register value and bandwidth of st from time_us on
+static void account(const ControllerOptions &opt, int channel, const ChannelState &st, uint64_t time_us) {
+    if (!opt.refresh)
+        return;
+    opt.refresh->update(channel, time_us, st.written & 0x7fff, st.read_mbps, st.write_mbps);
+    if (opt.metrics) {
+        const RefreshAccount &a = opt.refresh->channel(channel);
+        ChannelMetrics &m = opt.metrics->channel(channel);
+        const memory_order r = memory_order_relaxed;
+        m.refresh_duty.store(a.duty, r);
+        m.reclaimed.store(a.reclaimed, r);
+        m.reclaimed_mbps.store(a.theoretical_mbps, r);
+        m.gain_mbps.store(a.gain_mbps, r);
+    }
+}
+
+// trefi within the per channel bounds of opt
+static uint32_t clamp_trefi(const ControllerOptions &opt, int channel, uint32_t trefi) {
+    const uint32_t lo = channel < (int)opt.min_trefi.size() ? opt.min_trefi[channel] : 0;
+    const uint32_t hi = channel < (int)opt.max_trefi.size() ? opt.max_trefi[channel] : 0;
+    if (hi && trefi > hi)
+        return hi;
+    return lo && trefi < lo ? lo : trefi;
+}
+
+// write the policy's decision for one channel and pick its next sample time
+static void apply_decision(RegisterBackend &backend, const ControllerOptions &opt, int channel, ChannelState &st, const ChannelSample &s, const Decision &decided,
+                           uint64_t sampled_ns, ChannelStats *cs) {
+    RefreshPolicy &policy = *opt.policy;
+    Telemetry *telemetry = opt.telemetry;
+
+    // whatever the policy, a channel stays within the bounds of its own clock
+    Decision d = decided;
+    d.trefi = clamp_trefi(opt, channel, d.trefi);
+    d.limit = clamp_trefi(opt, channel, d.limit);
+
+    // only a tREFI that ran in the register for the error free interval
+    if (d.reason != REASON_ERR) {
+        st.safe_trefi = s.trefi;
+        st.safe_temp = s.temp;
+    }
+    const uint32_t value = st.tref_const + (d.trefi & 0x7fff);
+    st.target = d.trefi & 0x7fff;
+    const bool write = needs_write(opt, st, d, value);
+    if (write) {
+        const uint64_t w0 = opt.overhead ? overhead_now_ns() : 0;
+        backend.write32(channel, REG_TREFI, value);
+        st.written = value;
+        if (opt.overhead)
+            opt.overhead->write(channel).record(overhead_now_ns() - w0);
+    }
+    if (opt.overhead)
+        opt.overhead->decision(channel).record(overhead_now_ns() - sampled_ns);
+    account(opt, channel, st, s.time_us);
+
+    if (cs) {
+        if (d.reason == REASON_INC)
+            cs->increments++;
+        else if (d.reason == REASON_ERR || d.reason == REASON_ERR_CLEAR)
+            cs->decrements++;
+        if (d.reason == REASON_ERR)
+            cs->err_events++;
+        if (write)
+            cs->writes++;
+        else
+            cs->writes_avoided++;
+    }
+
+    if (opt.metrics) {
+        ChannelMetrics &m = opt.metrics->channel(channel);
+        const memory_order r = memory_order_relaxed;
+        m.temp.store(s.temp, r);
+        m.trefi.store(d.trefi, r);
+        m.limit.store(d.limit, r);
+        m.err_r0.store(s.err_r0, r);
+        m.err_r1.store(s.err_r1, r);
+        if (d.reason == REASON_INC)
+            m.increments.fetch_add(1, r);
+        else if (d.reason == REASON_ERR || d.reason == REASON_ERR_CLEAR)
+            m.decrements.fetch_add(1, r);
+        if (d.reason == REASON_ERR)
+            m.err_events.fetch_add(1, r);
+        (write ? m.writes : m.writes_avoided).fetch_add(1, r);
+    }
+
+    if (telemetry) {
+        TelemetryRecord rec = TelemetryRecord();
+        rec.time_us = s.time_us;
+        rec.channel = channel;
+        rec.reason = d.reason;
+        rec.flags = (s.ovf_r0 ? TELEMETRY_R0_OVF : 0) | (s.ovf_r1 ? TELEMETRY_R1_OVF : 0);
+        rec.temp = s.temp;
+        rec.err_r0 = s.err_r0;
+        rec.err_r1 = s.err_r1;
+        rec.trefi_before = s.trefi;
+        rec.trefi_after = d.trefi;
+        rec.limit = d.limit;
+        rec.read_mbps = st.read_mbps;
+        rec.write_mbps = st.write_mbps;
+        telemetry->push(rec);
+    }
+
+    // next sample: soon while errors are pending or the temperature moves,
+    // back off while the channel sits at its limit
+    if (policy.unstable(channel) || st.temp_step || !st.samples)
+        st.interval_us = opt.loop_sleep_min_us;
+    else if (d.trefi == d.limit)
+        st.interval_us = min<uint64_t>(max<uint64_t>(st.interval_us, opt.loop_sleep_us) * 2, opt.loop_sleep_max_us);
+    else
+        st.interval_us = opt.loop_sleep_us;
+    st.samples++;
+
+    if (cs) {
+        cs->samples++;
+        cs->trefi_sum += st.written & 0x7fff;
+    }
+}
+
+// sample every channel in due[begin, end), decide them together, write back
+static void update_channels(RegisterBackend &backend, const ControllerOptions &opt, const vector<int> &due, size_t begin, size_t end,
+                            vector<ChannelState> &state, vector<ChannelRegs> &regs, TickBatch &tick, ControllerStats *stats) {
+    const uint64_t t0 = opt.metrics || opt.overhead ? overhead_now_ns() : 0;
+    const uint64_t now = backend.nowUs();
+    backend.readChannels(&due[begin], end - begin, &regs[0]);
+    if (opt.overhead)
+        opt.overhead->read.record(overhead_now_ns() - t0);
+    for (size_t d = begin; d < end; d++) {
+        tick.due[due[d]] = 1;
+        sample_channel(opt, now, regs[d - begin], state[due[d]], tick.samples[due[d]]);
+    }
+    opt.policy->decideTick(&tick);
+    for (size_t d = begin; d < end; d++) {
+        const int i = due[d];
+        apply_decision(backend, opt, i, state[i], tick.samples[i], tick.decisions[i], t0, stats ? &stats->channels[i] : NULL);
+        tick.due[i] = 0;
+    }
+    if (opt.metrics)
+        opt.metrics->decision_latency.record(overhead_now_ns() - t0);
+}
+
+// the policy or the refresh accounting needs the measured bandwidth
+static bool wants_bandwidth(const ControllerOptions &opt) { return opt.policy->wantsBandwidth() || opt.refresh; }
+
+static void checkpoint(RegisterBackend &backend, const ControllerOptions &opt, const vector<ChannelState> &state) {
+    Checkpoint ckpt;
+    ckpt.written = time(NULL);
+    for (size_t i = 0; i < state.size(); i++) {
+        if (!state[i].safe_trefi)
+            continue;
+        const ChannelLocation &loc = backend.location(i);
+        ChannelCheckpoint c = {loc.socket, loc.imc, loc.channel, state[i].safe_trefi, state[i].safe_temp, opt.dram_mts, opt.base_trefi,
+                               (state[i].tref_const >> 15) & 0x1ff};
+        ckpt.channels.push_back(c);
+    }
+    opt.on_checkpoint(ckpt);
+}
+
+void run_controller(RegisterBackend &backend, const ControllerOptions &options, ControllerStats *stats) {
+    const int channels = backend.numChannels();
+    ControllerOptions opt = options; // a reload may change it
+    Telemetry *telemetry = opt.telemetry;
+    vector<ChannelState> state(channels);
+    SampleScheduler sched;
+    vector<int> due;
+    vector<float> bw(2 * channels, 0);
+    vector<int> reset;
+    TickBatch batch;
+    batch.resize(channels);
+    vector<ChannelRegs> regs(channels);
+
+    if (stats)
+        stats->channels.assign(channels, ChannelStats());
+    opt.policy->setTopology(backend.topology());
+    opt.policy->init(channels);
+
+    const uint64_t start = backend.nowUs();
+    for (int i = 0; i < channels; i++) {
+        uint32_t ch_tref_reg = 0;
+        backend.read32(i, REG_TREFI, &ch_tref_reg);
+        state[i].tref_const = ch_tref_reg & 0xffff8000;
+        // tRFC as the iMC has it, the configured one when the field is empty
+        if (opt.refresh && (ch_tref_reg >> 15) & 0x1ff) {
+            DramTiming t = opt.refresh->timing(i);
+            t.trfc_ck = (ch_tref_reg >> 15) & 0x1ff;
+            opt.refresh->setTiming(i, t);
+        }
+        const uint32_t trefi = clamp_trefi(opt, i, i < (int)opt.start_trefi.size() && opt.start_trefi[i] ? opt.start_trefi[i] : opt.base_trefi);
+        backend.write32(i, REG_TREFI, state[i].tref_const + (trefi & 0x7fff));
+        state[i].written = state[i].tref_const + (trefi & 0x7fff);
+        state[i].target = trefi & 0x7fff;
+        account(opt, i, state[i], start);
+        sched.schedule(i, start);
+        if (telemetry) {
+            TelemetryRecord rec = TelemetryRecord();
+            rec.time_us = start;
+            rec.channel = i;
+            rec.reason = REASON_INIT;
+            rec.trefi_before = ch_tref_reg & 0x7fff;
+            rec.trefi_after = trefi & 0x7fff;
+            telemetry->push(rec);
+        }
+    }
+
+    // the bandwidth sampler keeps the fixed period its averaging window is built on
+    const int bw_id = channels;
+    bool bw_scheduled = wants_bandwidth(opt);
+    if (bw_scheduled)
+        sched.schedule(bw_id, start);
+    const int ckpt_id = channels + 1;
+    bool ckpt_scheduled = opt.checkpoint_us && opt.on_checkpoint;
+    if (ckpt_scheduled)
+        sched.schedule(ckpt_id, start + opt.checkpoint_us);
+
+    for (uint64_t tick = 0; opt.max_ticks == 0 || tick < opt.max_ticks; tick++) {
+        if (opt.stop && *opt.stop)
+            break;
+        if (opt.dump && *opt.dump) {
+            *opt.dump = 0;
+            if (opt.on_dump)
+                opt.on_dump();
+        }
+        if (opt.reload && *opt.reload) {
+            *opt.reload = 0;
+            RefreshPolicy *const old = opt.policy;
+            if (opt.on_reload)
+                opt.on_reload(opt);
+            if (opt.policy != old) {
+                opt.policy->setTopology(backend.topology());
+                opt.policy->init(channels);
+            }
+            if (!bw_scheduled && wants_bandwidth(opt)) {
+                sched.schedule(bw_id, backend.nowUs());
+                bw_scheduled = true;
+            }
+            if (!ckpt_scheduled && opt.checkpoint_us && opt.on_checkpoint) {
+                sched.schedule(ckpt_id, backend.nowUs() + opt.checkpoint_us);
+                ckpt_scheduled = true;
+            }
+        }
+
+        uint64_t now = backend.nowUs();
+        if (opt.max_time_us && sched.nextDeadline() - start > opt.max_time_us)
+            break;
+        const uint64_t deadline = sched.nextDeadline();
+        if (deadline > now) {
+            backend.sleepUntil(deadline);
+            now = backend.nowUs();
+            if (opt.overhead)
+                opt.overhead->wake.record(now > deadline ? (now - deadline) * 1000 : 0);
+        }
+        // woke up late or the previous tick overran the deadline
+        if (opt.deadline_miss_us && now > deadline + opt.deadline_miss_us) {
+            if (stats)
+                stats->deadline_misses++;
+            if (opt.metrics)
+                opt.metrics->deadline_misses.fetch_add(1, memory_order_relaxed);
+        }
+        const uint64_t work0 = opt.overhead ? overhead_now_ns() : 0;
+        sched.popDue(now, &due);
+
+        for (size_t d = 0; d < due.size(); d++) {
+            const int channel = due[d];
+            if (channel == bw_id) {
+                if (!wants_bandwidth(opt)) {
+                    bw_scheduled = false;
+                    continue;
+                }
+                const uint64_t bw0 = opt.overhead ? overhead_now_ns() : 0;
+                backend.readBandwidth(&bw[0]);
+                if (opt.overhead)
+                    opt.overhead->bandwidth.record(overhead_now_ns() - bw0);
+                reset.clear();
+                opt.policy->onBandwidth(&bw[0], &reset);
+                for (int i = 0; i < channels; i++) {
+                    state[i].read_mbps = bw[2 * i + 0];
+                    state[i].write_mbps = bw[2 * i + 1];
+                    if (opt.metrics) {
+                        opt.metrics->channel(i).read_mbps.store(bw[2 * i + 0], memory_order_relaxed);
+                        opt.metrics->channel(i).write_mbps.store(bw[2 * i + 1], memory_order_relaxed);
+                    }
+                    account(opt, i, state[i], now);
+                }
+                for (size_t r = 0; r < reset.size(); r++) {
+                    const int i = reset[r];
+                    uint32_t ch_tref_reg = 0;
+                    backend.read32(i, REG_TREFI, &ch_tref_reg);
+                    const uint32_t halved = clamp_trefi(opt, i, (ch_tref_reg & 0x7fff) / 2);
+                    backend.write32(i, REG_TREFI, state[i].tref_const + halved);
+                    state[i].written = state[i].tref_const + halved;
+                    state[i].target = halved;
+                    account(opt, i, state[i], now);
+                    if (stats)
+                        stats->channels[i].writes++;
+                    if (opt.metrics) {
+                        opt.metrics->channel(i).bw_resets.fetch_add(1, memory_order_relaxed);
+                        opt.metrics->channel(i).writes.fetch_add(1, memory_order_relaxed);
+                    }
+                    if (telemetry) {
+                        TelemetryRecord rec = TelemetryRecord();
+                        rec.time_us = now;
+                        rec.channel = i;
+                        rec.reason = REASON_BW_RESET;
+                        rec.temp = state[i].last_temp;
+                        rec.err_r0 = state[i].err_r0;
+                        rec.err_r1 = state[i].err_r1;
+                        rec.trefi_before = ch_tref_reg & 0x7fff;
+                        rec.trefi_after = halved;
+                        rec.read_mbps = state[i].read_mbps;
+                        rec.write_mbps = state[i].write_mbps;
+                        telemetry->push(rec);
+                    }
+                }
+                sched.schedule(bw_id, now + opt.loop_sleep_us);
+                continue;
+            }
+            if (channel == ckpt_id) {
+                if (!opt.checkpoint_us) {
+                    ckpt_scheduled = false;
+                    continue;
+                }
+                checkpoint(backend, opt, state);
+                sched.schedule(ckpt_id, now + opt.checkpoint_us);
+                continue;
+            }
+            // a run of channels due together is decided as one batch, the
+            // bandwidth and checkpoint slots keep their place in between
+            size_t run = d + 1;
+            while (run < due.size() && due[run] < channels)
+                run++;
+            update_channels(backend, opt, due, d, run, state, regs, batch, stats);
+            for (; d < run; d++)
+                sched.schedule(due[d], now + state[due[d]].interval_us);
+            d--;
+        }
+        if (opt.overhead)
+            opt.overhead->tick.record(overhead_now_ns() - work0);
+        if (stats)
+            stats->ticks++;
+        if (opt.metrics)
+            opt.metrics->ticks.fetch_add(1, memory_order_relaxed);
+    }
+    // close the last interval of every channel
+    const uint64_t end = backend.nowUs();
+    for (int i = 0; i < channels; i++)
+        account(opt, i, state[i], end);
+    if (opt.on_checkpoint)
+        checkpoint(backend, opt, state);
+}
@@ -0,0 +1,104 @@
+// tREFI controller
+//
+// Backend agnostic version of the main_base_err_track_temp_slope.cpp loop so
+// the same control logic runs against real registers and the simulator. The
+// tREFI decision itself comes from a RefreshPolicy.
+
+#pragma once
+
+#include <signal.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include "address.h"
+#include "register_backend.h"
+
+struct Checkpoint;
+class ControllerMetrics;
+class OverheadStats;
+class RefreshAccounting;
+class RefreshPolicy;
+class Telemetry;
+
+struct ControllerOptions {
+    uint64_t max_ticks;   // scheduler wakeups, 0 runs forever
+    uint64_t max_time_us; // backend time to run for, 0 runs forever
+    RefreshPolicy *policy; // required
+    Telemetry *telemetry;  // one record per sample, NULL for none
+    ControllerMetrics *metrics; // gauges and counters for the exporter, NULL for none
+    OverheadStats *overhead;    // latency histograms of the loop itself, NULL for none
+    RefreshAccounting *refresh; // refresh duty cycle and reclaimed bandwidth, NULL for none
+
+    uint32_t base_trefi;        // written to every channel at startup
+    uint32_t dram_mts;          // DRAM clock, recorded in checkpoints
+    std::vector<uint32_t> start_trefi; // per channel tREFI to start from instead, 0 or missing for base_trefi
+    // per channel bounds every decision is clamped to (timing.h), 0 or missing for none
+    std::vector<uint32_t> min_trefi, max_trefi;
+    uint64_t loop_sleep_us;     // sample period of a channel that is still climbing
+    uint64_t loop_sleep_min_us; // after an error or a temperature step
+    uint64_t loop_sleep_max_us; // stable at the tREFI limit, reached by doubling the period
+    uint32_t temp_step;         // degC between two samples that count as a slope change
+    uint64_t deadline_miss_us;  // a tick this late against its deadline counts as a miss, 0 counts none
+    // a tREFI change of at most this many clocks from the value in the
+    // register is not written; errors are always written
+    uint32_t write_band_up, write_band_down;
+
+    // checked between ticks, on_reload is called with the running options
+    // (policy included) once a signal handler set *reload
+    volatile sig_atomic_t *reload;
+    std::function<void(ControllerOptions &)> on_reload;
+    volatile sig_atomic_t *stop; // ends the loop between ticks once set
+    volatile sig_atomic_t *dump; // on_dump is called between ticks once set, e.g. to print the overhead
+    std::function<void()> on_dump;
+
+    // called every checkpoint_us (0 for never) and once at the end with the
+    // last error free tREFI of every channel that has one
+    uint64_t checkpoint_us;
+    std::function<void(const Checkpoint &)> on_checkpoint;
+
+    ControllerOptions()
+        : max_ticks(0), max_time_us(0), policy(NULL), telemetry(NULL), metrics(NULL), overhead(NULL), refresh(NULL), base_trefi(base_tREFI), dram_mts(1866), loop_sleep_us(100000), loop_sleep_min_us(25000),
+          loop_sleep_max_us(1600000), temp_step(2), deadline_miss_us(1000), write_band_up(0), write_band_down(0), reload(NULL), stop(NULL), dump(NULL), checkpoint_us(0) {}
+};
+
+// controller state of one channel, carried between samples
+struct ChannelState {
+    uint32_t tref_const; // upper bits of the tREFI register, kept on every write
+    uint32_t err_r1, err_r0; // latest error counters
+    uint32_t last_temp;
+    bool temp_step; // the latest sample moved by more than temp_step
+    uint32_t safe_trefi, safe_temp; // last tREFI that ran without new errors, 0 for none yet
+    uint32_t written; // shadow of the tREFI register as last written, whole register
+    uint32_t target;  // tREFI the policy chose last, ahead of written within the bands
+    uint64_t samples;
+    uint64_t interval_us;        // time until the next sample of this channel
+    float read_mbps, write_mbps; // latest bandwidth sample
+
+    ChannelState()
+        : tref_const(0), err_r1(0), err_r0(0), last_temp(0), temp_step(false), safe_trefi(0), safe_temp(0), written(0), target(0), samples(0), interval_us(0),
+          read_mbps(0), write_mbps(0) {}
+};
+
+struct ChannelStats {
+    uint64_t samples;
+    uint64_t trefi_sum; // for the average tREFI
+    uint64_t increments;
+    uint64_t decrements;
+    uint64_t err_events; // samples where an error was detected
+    uint64_t writes;         // tREFI register writes
+    uint64_t writes_avoided; // decisions that left the register as it was
+
+    ChannelStats() : samples(0), trefi_sum(0), increments(0), decrements(0), err_events(0), writes(0), writes_avoided(0) {}
+};
+
+struct ControllerStats {
+    uint64_t ticks; // scheduler wakeups, each one samples every channel that is due
+    uint64_t deadline_misses;
+    std::vector<ChannelStats> channels;
+
+    ControllerStats() : ticks(0), deadline_misses(0) {}
+};
+
+void run_controller(RegisterBackend &backend, const ControllerOptions &opt, ControllerStats *stats);
@@ -0,0 +1,140 @@
+// Error tracking decision kernel, see errtrack_kernel.h
+
+#include <string.h>
+
+#include "errtrack_kernel.h"
+#include "telemetry.h"
+
+static size_t padded(int channels) { return (channels + ERRTRACK_LANES - 1) / ERRTRACK_LANES * ERRTRACK_LANES; }
+
+void ErrTrackState::resize(int channels) {
+    const size_t n = padded(channels);
+    pre_err_r0.assign(n, 0);
+    pre_err_r1.assign(n, 0);
+    err_det_r0.assign(n, 0);
+    err_det_r1.assign(n, 0);
+}
+
+void ErrTrackLanes::resize(int channels) {
+    const size_t n = padded(channels);
+    std::vector<int32_t> *v[] = {&due, &temp, &err_r0, &err_r1, &ovf_r0, &ovf_r1, &trefi, &target, &out_trefi, &out_limit, &out_reason};
+    for (size_t i = 0; i < sizeof(v) / sizeof(v[0]); i++)
+        v[i]->assign(n, 0);
+}
+
+// the decision of the original control loop
+int32_t errtrack_decide(const ErrTrackParams &p, ErrTrackState *st, int channel, int32_t temp, int32_t err_r0, int32_t err_r1, bool ovf_r0, bool ovf_r1,
+                        int32_t trefi, int32_t target, int32_t *limit, int32_t *reason) {
+    int32_t &pre_r0 = st->pre_err_r0[channel], &pre_r1 = st->pre_err_r1[channel];
+    int32_t &det_r0 = st->err_det_r0[channel], &det_r1 = st->err_det_r1[channel];
+    *limit = ceiling_limit(p.ceiling, temp);
+    *reason = REASON_INC;
+
+    if (!ovf_r1 && !ovf_r0 && pre_r1 >= err_r1 && pre_r0 >= err_r0) { // if no error
+        if (!det_r1 && !det_r0) {                                      // if no error, increase trefI
+            if (target < *limit - 16) {                                //  tREFI max
+                trefi = target + p.step_inc;
+            } else {
+                trefi = *limit;
+                *reason = REASON_AT_LIMIT;
+            }
+        } else {
+            // err_det 1 -> 0, one more step down
+            if (det_r1)
+                det_r1 = 0;
+            else
+                det_r0 = 0;
+            trefi -= p.step_dec;
+            *reason = REASON_ERR_CLEAR;
+        }
+    } else { // if error
+        if (ovf_r1 || pre_r1 < err_r1)
+            det_r1 = -1;
+        if (ovf_r0 || pre_r0 < err_r0)
+            det_r0 = -1;
+        trefi -= p.step_dec;
+        *reason = REASON_ERR;
+    }
+    if (trefi > 0x7fff) // a step from just below a ceiling at the top of the field
+        trefi = 0x7fff;
+    if (trefi < p.min_trefi)
+        trefi = p.min_trefi;
+    pre_r1 = err_r1;
+    pre_r0 = err_r0;
+    return trefi;
+}
+
+// the helpers below are static inline, the ABI note about passing 32 byte
+// vectors without AVX does not apply; without AVX the compiler splits every
+// operation into two SSE halves
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+typedef int32_t vint __attribute__((vector_size(ERRTRACK_LANES * sizeof(int32_t))));
+
+static inline vint load(const std::vector<int32_t> &v, size_t i) {
+    vint r;
+    memcpy(&r, &v[i], sizeof(r));
+    return r;
+}
+
+static inline void store(std::vector<int32_t> &v, size_t i, vint r) { memcpy(&v[i], &r, sizeof(r)); }
+
+// lane wise mask ? a : b, masks are 0 or -1
+static inline vint select(vint mask, vint a, vint b) { return (mask & a) | (~mask & b); }
+
+static inline vint splat(int32_t x) {
+    vint r;
+    for (int i = 0; i < ERRTRACK_LANES; i++)
+        r[i] = x;
+    return r;
+}
+
+void errtrack_kernel(const ErrTrackParams &p, ErrTrackState *st, ErrTrackLanes *l) {
+    const vint zero = splat(0), max_trefi = splat(0x7fff);
+    const vint inc = splat(p.step_inc), dec = splat(p.step_dec), min_trefi = splat(p.min_trefi);
+    const vint slope = splat(p.ceiling.slope), offset = splat(p.ceiling.offset);
+    const vint temp_min = splat(p.ceiling.temp_min), temp_max = splat(p.ceiling.temp_max);
+    const vint r_inc = splat(REASON_INC), r_at_limit = splat(REASON_AT_LIMIT), r_err = splat(REASON_ERR), r_clear = splat(REASON_ERR_CLEAR);
+
+    for (size_t i = 0; i < l->due.size(); i += ERRTRACK_LANES) {
+        const vint due = load(l->due, i) != zero;
+        const vint r0 = load(l->err_r0, i), r1 = load(l->err_r1, i);
+        const vint pre_r0 = load(st->pre_err_r0, i), pre_r1 = load(st->pre_err_r1, i);
+        const vint det_r0 = load(st->err_det_r0, i), det_r1 = load(st->err_det_r1, i);
+        const vint ovf_r0 = load(l->ovf_r0, i) != zero, ovf_r1 = load(l->ovf_r1, i) != zero;
+        const vint trefi = load(l->trefi, i), target = load(l->target, i);
+
+        vint t = load(l->temp, i);
+        t = select(t < temp_min, temp_min, t);
+        t = select(t > temp_max, temp_max, t);
+        vint limit = (offset - slope * t) >> 8;
+        limit = select(limit > max_trefi, max_trefi, limit);
+
+        const vint no_err = ~ovf_r1 & ~ovf_r0 & (pre_r1 >= r1) & (pre_r0 >= r0);
+        const vint settled = (det_r1 == zero) & (det_r0 == zero);
+        const vint climb = no_err & settled;
+        const vint clear = no_err & ~settled;
+        const vint at_limit = target >= limit - 16;
+
+        vint out = select(climb, select(at_limit, limit, target + inc), trefi - dec);
+        out = select(out > max_trefi, max_trefi, out);
+        out = select(out < min_trefi, min_trefi, out);
+        const vint reason = select(climb, select(at_limit, r_at_limit, r_inc), select(no_err, r_clear, r_err));
+
+        // clearing drops rank 1 first, a new error sets the ranks that saw one
+        vint new_det_r1 = det_r1 & ~clear;
+        vint new_det_r0 = det_r0 & ~(clear & (det_r1 == zero));
+        new_det_r1 |= ~no_err & (ovf_r1 | (pre_r1 < r1));
+        new_det_r0 |= ~no_err & (ovf_r0 | (pre_r0 < r0));
+
+        store(st->pre_err_r0, i, select(due, r0, pre_r0));
+        store(st->pre_err_r1, i, select(due, r1, pre_r1));
+        store(st->err_det_r0, i, select(due, new_det_r0, det_r0));
+        store(st->err_det_r1, i, select(due, new_det_r1, det_r1));
+        store(l->out_trefi, i, out);
+        store(l->out_limit, i, limit);
+        store(l->out_reason, i, reason);
+    }
+}
@@ -0,0 +1,65 @@
+// Error tracking decision kernel
+//
+// The err-track family (err-track, temp-slope and the policies built on
+// them) decides every channel of a controller tick at once: channel state
+// and samples are kept as structure of arrays, padded to a multiple of
+// ERRTRACK_LANES, and the step/limit/clamp logic runs branch free in 32 bit
+// integers on GCC/Clang vector types, so the compiler emits SSE/AVX for the
+// whole block instead of one if/else chain per channel.
+//
+// The tREFI ceiling is fixed point: Q8 slope and offset, whole degC bounds,
+//   limit = min((offset - slope * clamp(temp, temp_min, temp_max)) >> 8, 0x7fff)
+// which is exact for the defaults (multiples of 1/32). The line itself may
+// run above the 15 bit field at fast clocks, the limit and tREFI saturate
+// at it. errtrack_decide() is the scalar reference, errtrack_kernel()
+// has to match it bit for bit; dynamicRefresh-kernel-check (ctest) verifies
+// that.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#define ERRTRACK_LANES 8
+
+struct CeilingQ8 {
+    int32_t slope, offset;      // tREFI per degC and tREFI at 0 degC, Q8
+    int32_t temp_min, temp_max; // degC
+};
+
+struct ErrTrackParams {
+    int32_t step_inc, step_dec, min_trefi;
+    CeilingQ8 ceiling;
+};
+
+inline int32_t ceiling_limit(const CeilingQ8 &c, int32_t temp) {
+    const int32_t t = temp < c.temp_min ? c.temp_min : temp > c.temp_max ? c.temp_max : temp;
+    const int32_t limit = (c.offset - c.slope * t) >> 8;
+    return limit > 0x7fff ? 0x7fff : limit;
+}
+
+// per-channel state, one lane per channel
+struct ErrTrackState {
+    std::vector<int32_t> pre_err_r0, pre_err_r1; // counters of the previous sample
+    std::vector<int32_t> err_det_r0, err_det_r1; // 0 or -1, an error still settling
+
+    void resize(int channels);
+};
+
+// one tick, lanes with due[i] != 0 are decided, the rest keep their state and
+// get undefined outputs
+struct ErrTrackLanes {
+    std::vector<int32_t> due, temp, err_r0, err_r1, ovf_r0, ovf_r1, trefi, target; // inputs, ovf 0 or 1
+    std::vector<int32_t> out_trefi, out_limit, out_reason;                 // outputs
+
+    void resize(int channels);
+};
+
+// scalar reference for one channel, returns the new tREFI: a step up from
+// target (ChannelSample::target) or a step down from trefi, the register
+int32_t errtrack_decide(const ErrTrackParams &p, ErrTrackState *st, int channel, int32_t temp, int32_t err_r0, int32_t err_r1, bool ovf_r0, bool ovf_r1,
+                        int32_t trefi, int32_t target, int32_t *limit, int32_t *reason);
+
+// every lane of the tick at once
+void errtrack_kernel(const ErrTrackParams &p, ErrTrackState *st, ErrTrackLanes *lanes);
@@ -6,555 +6,271 @@
 // Updated by Gregory Jun: 12-10-2022
 
 #define PCM_USE_PCI_MM_LINUX
-//#define BW_STUFF
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
-#include <unistd.h>
 
-#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <string>
-
-#include "address.h"
+#include <vector>
+
+#include "accounting.h"
+#include "bench.h"
+#include "characterize.h"
+#include "checkpoint.h"
+#include "controller.h"
+#include "config.h"
 #include "cpucounters.h"
+#include "metrics.h"
+#include "overhead.h"
+#include "pcm_backend.h"
+#include "policy.h"
+#include "rt.h"
+#include "telemetry.h"
+#include "timing.h"
 
 using namespace std;
 using namespace pcm;
 
-#define LOOP_SLEEP (400000 / num_channel) // microseconds
-
-// BW related functions and variables
-#define PCM_DELAY_DEFAULT (LOOP_SLEEP / 1000000) // in seconds
-#define PCM_DELAY_MIN 0.015                      // 15 milliseconds is practical on most modern CPUs
-
-#define DEFAULT_DISPLAY_COLUMNS 2
-
-constexpr uint32 max_sockets = 256;
-uint32 max_imc_channels = ServerUncoreCounterState::maxChannels;
-const uint32 max_edc_channels = ServerUncoreCounterState::maxChannels;
-const uint32 max_imc_controllers = ServerUncoreCounterState::maxControllers;
-
-bool skipInactiveChannels = true;
-bool enforceFlush = false;
-
-typedef struct memdata {
-    float iMC_Rd_socket_chan[max_sockets][ServerUncoreCounterState::maxChannels]{};
-    float iMC_Wr_socket_chan[max_sockets][ServerUncoreCounterState::maxChannels]{};
-    float iMC_PMM_Rd_socket_chan[max_sockets][ServerUncoreCounterState::maxChannels]{};
-    float iMC_PMM_Wr_socket_chan[max_sockets][ServerUncoreCounterState::maxChannels]{};
-    float iMC_PMM_MemoryMode_Miss_socket_chan[max_sockets][ServerUncoreCounterState::maxChannels]{};
-    float iMC_Rd_socket[max_sockets]{};
-    float iMC_Wr_socket[max_sockets]{};
-    float iMC_PMM_Rd_socket[max_sockets]{};
-    float iMC_PMM_Wr_socket[max_sockets]{};
-    float iMC_PMM_MemoryMode_Miss_socket[max_sockets]{};
-    bool iMC_NM_hit_rate_supported{};
-    float iMC_PMM_MemoryMode_Hit_socket[max_sockets]{};
-    bool M2M_NM_read_hit_rate_supported{};
-    float iMC_NM_hit_rate[max_sockets]{};
-    float M2M_NM_read_hit_rate[max_sockets][max_imc_controllers]{};
-    float EDC_Rd_socket_chan[max_sockets][max_edc_channels]{};
-    float EDC_Wr_socket_chan[max_sockets][max_edc_channels]{};
-    float EDC_Rd_socket[max_sockets]{};
-    float EDC_Wr_socket[max_sockets]{};
-    uint64 partial_write[max_sockets]{};
-    ServerUncoreMemoryMetrics metrics{};
-} memdata_t;
-
-bool anyPmem(const ServerUncoreMemoryMetrics &metrics) { return (metrics == Pmem) || (metrics == PmemMixedMode) || (metrics == PmemMemoryMode); }
-
-void calculate_bandwidth(PCM *m, const ServerUncoreCounterState uncState1[], const ServerUncoreCounterState uncState2[], const uint64 elapsedTime,
-                         const ServerUncoreMemoryMetrics &metrics, float BW[num_channel * 2]) {
-    memdata_t md;
-    md.metrics = metrics;
-    md.M2M_NM_read_hit_rate_supported = (m->getCPUModel() == PCM::SKX);
-    md.iMC_NM_hit_rate_supported = (m->getCPUModel() == PCM::ICX);
-
-    for (uint32 skt = 0; skt < max_sockets; ++skt) {
-        md.iMC_Rd_socket[skt] = 0.0;
-        md.iMC_Wr_socket[skt] = 0.0;
-        md.iMC_PMM_Rd_socket[skt] = 0.0;
-        md.iMC_PMM_Wr_socket[skt] = 0.0;
-        md.iMC_PMM_MemoryMode_Miss_socket[skt] = 0.0;
-        md.iMC_PMM_MemoryMode_Hit_socket[skt] = 0.0;
-        md.iMC_NM_hit_rate[skt] = 0.0;
-        md.EDC_Rd_socket[skt] = 0.0;
-        md.EDC_Wr_socket[skt] = 0.0;
-        md.partial_write[skt] = 0;
-        for (uint32 i = 0; i < max_imc_controllers; ++i) {
-            md.M2M_NM_read_hit_rate[skt][i] = 0.;
-        }
-    }
-
-    for (uint32 skt = 0; skt < m->getNumSockets(); ++skt) {
-        const uint32 numChannels1 = (uint32)m->getMCChannels(skt, 0); // number of channels in the first controller
-
-        auto toBW = [&elapsedTime](const uint64 nEvents) { return (float)(nEvents * 64 / 1000000.0 / (elapsedTime / 1000.0)); };
-
-        if (m->MCDRAMmemoryTrafficMetricsAvailable()) {
-            for (uint32 channel = 0; channel < max_edc_channels; ++channel) {
-                if (skipInactiveChannels && getEDCCounter(channel, ServerPCICFGUncore::EventPosition::READ, uncState1[skt], uncState2[skt]) == 0.0 &&
-                    getEDCCounter(channel, ServerPCICFGUncore::EventPosition::WRITE, uncState1[skt], uncState2[skt]) == 0.0) {
-                    md.EDC_Rd_socket_chan[skt][channel] = -1.0;
-                    md.EDC_Wr_socket_chan[skt][channel] = -1.0;
-                    continue;
-                }
-
-                md.EDC_Rd_socket_chan[skt][channel] = toBW(getEDCCounter(channel, ServerPCICFGUncore::EventPosition::READ, uncState1[skt], uncState2[skt]));
-                md.EDC_Wr_socket_chan[skt][channel] = toBW(getEDCCounter(channel, ServerPCICFGUncore::EventPosition::WRITE, uncState1[skt], uncState2[skt]));
-
-                md.EDC_Rd_socket[skt] += md.EDC_Rd_socket_chan[skt][channel];
-                md.EDC_Wr_socket[skt] += md.EDC_Wr_socket_chan[skt][channel];
-            }
-        }
-
-        for (uint32 channel = 0; channel < max_imc_channels; ++channel) {
-            uint64 reads = 0, writes = 0, pmmReads = 0, pmmWrites = 0, pmmMemoryModeCleanMisses = 0, pmmMemoryModeDirtyMisses = 0;
-            uint64 pmmMemoryModeHits = 0;
-            reads = getMCCounter(channel, ServerPCICFGUncore::EventPosition::READ, uncState1[skt], uncState2[skt]);
-            writes = getMCCounter(channel, ServerPCICFGUncore::EventPosition::WRITE, uncState1[skt], uncState2[skt]);
-            if (metrics == Pmem) {
-                pmmReads = getMCCounter(channel, ServerPCICFGUncore::EventPosition::PMM_READ, uncState1[skt], uncState2[skt]);
-                pmmWrites = getMCCounter(channel, ServerPCICFGUncore::EventPosition::PMM_WRITE, uncState1[skt], uncState2[skt]);
-            } else if (metrics == PmemMixedMode || metrics == PmemMemoryMode) {
-                pmmMemoryModeCleanMisses = getMCCounter(channel, ServerPCICFGUncore::EventPosition::PMM_MM_MISS_CLEAN, uncState1[skt], uncState2[skt]);
-                pmmMemoryModeDirtyMisses = getMCCounter(channel, ServerPCICFGUncore::EventPosition::PMM_MM_MISS_DIRTY, uncState1[skt], uncState2[skt]);
-            }
-            if (metrics == PmemMemoryMode) {
-                pmmMemoryModeHits = getMCCounter(channel, ServerPCICFGUncore::EventPosition::NM_HIT, uncState1[skt], uncState2[skt]);
-            }
-            if (skipInactiveChannels && (reads + writes == 0)) {
-                if ((metrics != Pmem) || (pmmReads + pmmWrites == 0)) {
-                    if ((metrics != PmemMixedMode) || (pmmMemoryModeCleanMisses + pmmMemoryModeDirtyMisses == 0)) {
-                        md.iMC_Rd_socket_chan[skt][channel] = -1.0;
-                        md.iMC_Wr_socket_chan[skt][channel] = -1.0;
-                        continue;
-                    }
-                }
-            }
-
-            if (metrics != PmemMemoryMode) {
-                md.iMC_Rd_socket_chan[skt][channel] = toBW(reads);
-                md.iMC_Wr_socket_chan[skt][channel] = toBW(writes);
-
-                md.iMC_Rd_socket[skt] += md.iMC_Rd_socket_chan[skt][channel];
-                md.iMC_Wr_socket[skt] += md.iMC_Wr_socket_chan[skt][channel];
-            }
-
-            if (metrics == Pmem) {
-                md.iMC_PMM_Rd_socket_chan[skt][channel] = toBW(pmmReads);
-                md.iMC_PMM_Wr_socket_chan[skt][channel] = toBW(pmmWrites);
-
-                md.iMC_PMM_Rd_socket[skt] += md.iMC_PMM_Rd_socket_chan[skt][channel];
-                md.iMC_PMM_Wr_socket[skt] += md.iMC_PMM_Wr_socket_chan[skt][channel];
-
-                md.M2M_NM_read_hit_rate[skt][(channel < numChannels1) ? 0 : 1] += (float)reads;
-            } else if (metrics == PmemMixedMode) {
-                md.iMC_PMM_MemoryMode_Miss_socket_chan[skt][channel] = toBW(pmmMemoryModeCleanMisses + 2 * pmmMemoryModeDirtyMisses);
-                md.iMC_PMM_MemoryMode_Miss_socket[skt] += md.iMC_PMM_MemoryMode_Miss_socket_chan[skt][channel];
-            } else if (metrics == PmemMemoryMode) {
-                md.iMC_PMM_MemoryMode_Miss_socket[skt] += (float)((pmmMemoryModeCleanMisses + pmmMemoryModeDirtyMisses) / (elapsedTime / 1000.0));
-                md.iMC_PMM_MemoryMode_Hit_socket[skt] += (float)((pmmMemoryModeHits) / (elapsedTime / 1000.0));
-            } else {
-                md.partial_write[skt] +=
-                    (uint64)(getMCCounter(channel, ServerPCICFGUncore::EventPosition::PARTIAL, uncState1[skt], uncState2[skt]) / (elapsedTime / 1000.0));
-            }
-        }
-    }
-
-    // pass back
-    for (int i = 0; i < num_channel; i++) {          // channel
-        BW[i * 2 + 0] = md.iMC_Rd_socket_chan[0][i]; // md.imc -> socket - channel
-        BW[i * 2 + 1] = md.iMC_Wr_socket_chan[0][i]; // md.imc -> socket - channel
+static volatile sig_atomic_t reload_requested = 0;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static volatile sig_atomic_t dump_requested = 0;
+
+static void on_sighup(int) { reload_requested = 1; }
+static void on_stop(int) { stop_requested = 1; }
+static void on_sigusr1(int) { dump_requested = 1; }
+
+// -X: sweep tREFI under a pattern load of load_mb per NUMA node and write the retention
+// profile. SIGINT/SIGTERM end the sweep early, base_trefi is restored and the
+// failure points found so far are saved.
+static int characterize(RegisterBackend &backend, const RefreshConfig &cfg, const string &path, size_t load_mb) {
+    CharacterizeOptions copt;
+    apply_config(cfg, &copt);
+    copt.stop = &stop_requested;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    PatternLoad load(load_mb << 20, numa_cpu_sets());
+    if (load_mb)
+        load.start();
+    std::cout << " characterizing, step " << copt.step << " dwell " << copt.dwell_us << " us, " << copt.sweeps << " sweeps per channel, " << load_mb
+              << " MB pattern load per node\n";
+    RetentionProfile profile;
+    CharacterizeStats stats;
+    run_characterization(backend, copt, &profile, &stats);
+    load.stop();
+
+    string err;
+    if (!profile.save(path, &err)) {
+        std::cerr << err << "\n";
+        return 1;
     }
+    for (int i = 0; i < backend.numChannels(); i++)
+        std::cout << " " << channel_name(backend.location(i)) << ": failures " << stats.failures[i] << ", clean sweeps " << stats.clean[i] << "\n";
+    if (load.mismatches())
+        std::cout << " pattern load saw " << load.mismatches() << " mismatches in " << load.passes() << " passes\n";
+    std::cout << " profile written to " << path << "\n";
+    return 0;
 }
 
-// BW related functions and variables
-
 int main(int argc, char *argv[]) {
     std::cout << "\n Processor Counter Monitor " << PCM_VERSION << "\n";
     std::cout << "\n PCICFG read/write utility\n\n";
 
-    uint32 value = 0;
-    uint32 ch_temp_reg = 0;
-    uint32 ch_temp_val = 0;
-    uint32 ch_tref_reg = 0;
-    uint32 ch_tref_const = 0;
-    uint32 ch_trefi_val = 0;
-    uint32 ch_err_reg = 0;
-    uint32 ch_err_r1_val = 0;
-    uint32 ch_err_r0_val = 0;
-    uint32 ch_r1_ovrflw = 0;
-    uint32 ch_r0_ovrflw = 0;
-    uint32 pre_err_r1_val = 0, pre_err_r0_val = 0;
-    uint32 pre_a_err_r1_val = 0, pre_b_err_r1_val = 0, pre_c_err_r1_val = 0, pre_d_err_r1_val = 0;
-    uint32 pre_a_err_r0_val = 0, pre_b_err_r0_val = 0, pre_c_err_r0_val = 0, pre_d_err_r0_val = 0;
-
-    bool write = false;
-    bool dec = false;
-    bool err_det_r1 = false, err_det_r0 = false;
-    bool pre_a_err_det_r1 = false, pre_a_err_det_r0 = false, pre_b_err_det_r1 = false, pre_b_err_det_r0 = false, pre_c_err_det_r1 = false,
-         pre_c_err_det_r0 = false, pre_d_err_det_r1 = false, pre_d_err_det_r0 = false;
+    ControllerOptions opt;
+    TelemetryFormat format = TELEMETRY_TEXT;
+    const char *out_path = NULL;
+    string config_path, profile_out, endpoint;
+    vector<string> overrides;
+    size_t load_mb = 256;
+    RtOptions rt;
+    string smbios_dir = SMBIOS_ENTRIES;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc && parse_telemetry_format(argv[i + 1], &format))
+            i++;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            out_path = argv[++i];
+        else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc)
+            config_path = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            overrides.push_back(string("policy=") + argv[++i]);
+        else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc)
+            overrides.push_back(argv[++i]);
+        else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc)
+            overrides.push_back(string("profile=") + argv[++i]);
+        else if (strcmp(argv[i], "-X") == 0 && i + 1 < argc)
+            profile_out = argv[++i];
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            load_mb = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            endpoint = argv[++i];
+        else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+            rt.priority = atoi(argv[++i]);
+            rt.lock_memory = true;
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+            rt.cpu = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc)
+            smbios_dir = argv[++i];
+        else {
+            std::cerr << "usage: " << argv[0] << " [-f text|csv|binary] [-o file] [-C config] [-p policy] [-P key=value] [-L profile] [-X profile [-w MB]] [-e endpoint] [-R priority] [-a cpu] [-D smbios_dir]\n";
+            std::cerr << "  policies: " << policy_names() << " (default temp-slope), SIGHUP reloads the config file\n";
+            std::cerr << "  -L starts from a retention profile, -X writes one by sweeping tREFI under a pattern load of -w MB per NUMA node (default 256)\n";
+            std::cerr << "  -R runs the control loop SCHED_FIFO at priority (1-99) with its memory locked, -a pins it to a housekeeping cpu\n";
+            std::cerr << "  SIGUSR1 prints the latency and overhead histograms and the refresh accounting of the control loop to stderr\n";
+            std::cerr << "  base_trefi follows the DRAM clock of the SMBIOS memory devices under -D (default " SMBIOS_ENTRIES ", empty for none)\n";
+            std::cerr << "  or of the tREFI the BIOS programmed\n";
+            std::cerr << "  -e serves Prometheus metrics on [host:]port (localhost without a host) or a Unix socket path\n";
+            return 1;
+        }
+    }
 
-    int channel = 0; // Channel A=0, B=1, C=2, D=3
-    int tREFI_limit = 4 * base_tREFI;
-    int ch_a_group = CH_A_Group, ch_b_group = CH_B_Group, ch_c_group = CH_C_Group, ch_d_group = CH_D_Group;
-    int ch_a_bus = CH_A_Bus, ch_b_bus = CH_B_Bus, ch_c_bus = CH_C_Bus, ch_d_bus = CH_D_Bus;
-    int ch_a_device = CH_A_Device, ch_b_device = CH_B_Device, ch_c_device = CH_C_Device, ch_d_device = CH_D_Device;
-    int ch_a_func = CH_A_Func, ch_b_func = CH_B_Func, ch_c_func = CH_C_Func, ch_d_func = CH_D_Func;
-    int ch_a_err_func = CH_A_Err_Func, ch_b_err_func = CH_B_Err_Func, ch_c_err_func = CH_C_Err_Func, ch_d_err_func = CH_D_Err_Func;
-    int temp_off = Temp_Off;
-    int tREFI_off = tREFI_Off;
-    int err_cnt_off = Err_cnt_Off;
+    FILE *out = stdout;
+    if (out_path && (out = fopen(out_path, format == TELEMETRY_BINARY ? "wb" : "w")) == NULL) {
+        std::cerr << "can not open " << out_path << "\n";
+        return 1;
+    }
 
+    string err;
     try {
-        // PciHandleType h(group, bus, device, function);
-
-        // Set IMC register address (IMC Thermal Control)
-        PciHandleType ch_a_thermal(ch_a_group, ch_a_bus, ch_a_device, ch_a_func);
-        PciHandleType ch_b_thermal(ch_b_group, ch_b_bus, ch_b_device, ch_b_func);
-        PciHandleType ch_c_thermal(ch_c_group, ch_c_bus, ch_c_device, ch_c_func);
-        PciHandleType ch_d_thermal(ch_d_group, ch_d_bus, ch_d_device, ch_d_func);
-        // Set IMC register address (IMC Error Registers)
-        PciHandleType ch_a_err(ch_a_group, ch_a_bus, ch_a_device, ch_a_err_func);
-        PciHandleType ch_b_err(ch_b_group, ch_b_bus, ch_b_device, ch_b_err_func);
-        PciHandleType ch_c_err(ch_c_group, ch_c_bus, ch_c_device, ch_c_err_func);
-        PciHandleType ch_d_err(ch_d_group, ch_d_bus, ch_d_device, ch_d_err_func);
-        // Register Variable
-        PciHandleType ch_thermal = ch_a_thermal;
-        PciHandleType ch_err = ch_a_err;
-
-        if (!dec)
-            std::cout << std::hex << std::showbase;
-        ch_a_thermal.read32(tREFI_off, &ch_tref_reg);
-        ch_tref_const = ch_tref_reg & 0xffff8000;
-        ch_trefi_val = base_tREFI & 0x7fff;
-        ch_a_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
-        ch_b_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
-        ch_c_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
-        ch_d_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
-
-#ifdef BW_STUFF
-        /// BW related Vars ///////////////////////////////////////////////////////////////////////////
-        double delay = PCM_DELAY_DEFAULT;
-        bool csv = false, csvheader = false, show_channel_output = true, print_update = false;
-        uint32 no_columns = DEFAULT_DISPLAY_COLUMNS; // Default number of columns is 2
-        char *sysCmd = NULL;
-        int rankA = -1, rankB = -1;
-        MainLoop mainLoop;
-
-        PCM *m = PCM::getInstance();
-        ServerUncoreMemoryMetrics metrics;
-        metrics = m->PMMTrafficMetricsAvailable() ? Pmem : PartialWrites;
-        max_imc_channels = (pcm::uint32)m->getMCChannelsPerSocket();
-
-        m->disableJKTWorkaround();
-        m->setBlocked(false);
-
-        ServerUncoreCounterState *BeforeState = new ServerUncoreCounterState[m->getNumSockets()];
-        ServerUncoreCounterState *AfterState = new ServerUncoreCounterState[m->getNumSockets()];
-        uint64 BeforeTime = 0, AfterTime = 0;
-
-        for (uint32 i = 0; i < m->getNumSockets(); ++i)
-            BeforeState[i] = m->getServerUncoreCounterState(i);
-        BeforeTime = m->getTickCount();
-
-        float BW[2 * num_channel] = {0};             // channel - read/write in MB/s //hard coded for a
-                                                     // four channel system
-        float BW_average[2 * num_channel * 2] = {0}; // phase - channel - read/write
-        int count = 0;
-        int phase = 0;
-        bool steady_state = false;
-
-        int reset_signal[num_channel] = {0};
-        int donot_reset_signal[num_channel] = {0};
-        int do_not_reset_count[num_channel] = {0};
-        /// BW related Vars ///////////////////////////////////////////////////////////////////////////
-#endif
-
-        while (1) {
-            std::cout << " Channel variable : " << channel << "\n\n";
-
-#ifdef BW_STUFF
-            // bw read
-            count++;
-			// count the number of loops passed since being reset
-            for (int i = 0; i < num_channel; i++) {
-                if (donot_reset_signal[i]) {
-                    do_not_reset_count[i]++;
-                }
-            }
-            AfterTime = m->getTickCount();
-            for (uint32 i = 0; i < m->getNumSockets(); ++i)
-                AfterState[i] = m->getServerUncoreCounterState(i);
-
-            calculate_bandwidth(m, BeforeState, AfterState, AfterTime - BeforeTime, metrics, BW);
-            swap(BeforeTime, AfterTime);
-            swap(BeforeState, AfterState);
-
-            // print
-            std::cout << "Bandwidth for Channels (read - write):" << std::endl;
-            for (int i = 0; i < num_channel; i++) {
-                cout << "Channel " << i << ": " << BW[2 * i + 0] << " - " << BW[2 * i + 1] << endl;
-            }
-
-            // reset the reset signal
-            for (int i = 0; i < num_channel; i++) {
-                reset_signal[i] = 0;
-            }
-
-            // bw average -> steady state after 10 cycles
-            if (count == average_loop_count) {
-                steady_state = true;
-                count = 0;
-
-                // compute average bw
-                for (int i = 0; i < (num_channel * 2); i++) {
-                    BW_average[phase * (num_channel * 2) + i] /= average_loop_count;
-                }
-
-                // change phase
-                if (phase == 0) {
-                    phase = 1;
-                } else {
-                    phase = 0;
-                }
-
-                // reset average value for phase
-                for (int i = 0; i < (num_channel * 2); i++) {
-                    BW_average[phase * (num_channel * 2) + i] = 0;
-                }
-            }
-
-            // store cumulative bw vals
-            for (int i = 0; i < num_channel; i++) {
-                for (int j = 0; j < 2; j++) {
-                    BW_average[phase * (num_channel * 2) + i * 2 + j] += BW[i * 2 + j];
-                }
-            }
-
-            // after average_loop_count * average_loop_count loops enable reset again
-            for (int i = 0; i < num_channel; i++) {
-                if (donot_reset_signal[i] && (do_not_reset_count[i] > average_loop_count * average_loop_count)) {
-                    donot_reset_signal[i] = 0;
-                }
+        PcmRegisterBackend backend(discover_topology());
+        for (int i = 0; i < backend.numChannels(); i++) {
+            const ChannelLocation &loc = backend.location(i);
+            std::cout << " " << channel_name(loc) << std::hex << " bus " << loc.bus << " device " << loc.device << " func " << loc.func << "/"
+                      << loc.err_func << std::dec << "\n";
+        }
+        // base_trefi and dram_mts default to what the DIMMs run at, the
+        // file and -P can still set them. A checkpoint means an earlier run
+        // may have left its own tREFI in the registers, then they say
+        // nothing about the clock and the one that run recorded counts.
+        RefreshConfig probe;
+        ClockFallback fallback;
+        if (load_config(config_path, overrides, &probe, &err))
+            fallback = clock_fallback(probe);
+        else
+            fallback.trust_register = false;
+        const vector<ChannelTiming> discovered = discover_timing(backend, smbios_dir, fallback);
+        print_timing(std::cout, backend, discovered);
+        RefreshConfig defaults;
+        apply_timing(discovered, &defaults);
+
+        RefreshConfig cfg;
+        if (!load_config(config_path, overrides, &cfg, &err, &defaults)) {
+            std::cerr << err << "\n";
+            return 1;
+        }
+        std::unique_ptr<RefreshPolicy> policy(make_policy(cfg, &err));
+        if (!policy) {
+            std::cerr << err << "\n";
+            return 1;
+        }
+        apply_config(cfg, &opt);
+        apply_timing(discovered, &opt);
+        opt.policy = policy.get();
+        std::cout << " policy " << policy->name() << ", base tREFI(ck) " << cfg.base_trefi << "\n";
+        policy->printParams(std::cout);
+
+        // a bad file on reload keeps the running configuration
+        opt.reload = &reload_requested;
+        opt.on_reload = [&](ControllerOptions &running) {
+            string why;
+            if (!reload_config(config_path, overrides, &running, &policy, &why, &defaults)) {
+                std::cerr << " reload failed, keeping the running configuration: " << why << "\n";
+                return;
             }
+            std::cout << " reloaded, policy " << policy->name() << "\n";
+            policy->printParams(std::cout);
+        };
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_sighup;
+        sigaction(SIGHUP, &sa, NULL);
+
+        if (!profile_out.empty())
+            return characterize(backend, cfg, profile_out, load_mb);
+        if (!apply_profile(cfg, backend, &opt, &err)) {
+            std::cerr << err << "\n";
+            return 1;
+        }
+        int resumed = 0;
+        if (!apply_checkpoint(cfg, backend, &opt, &resumed, &err))
+            std::cerr << " ignoring checkpoint: " << err << "\n";
+        else if (resumed)
+            std::cout << " resumed " << resumed << " channels from " << cfg.checkpoint << "\n";
+        for (size_t i = 0; i < opt.start_trefi.size(); i++) {
+            if (opt.start_trefi[i])
+                std::cout << " " << channel_name(backend.location(i)) << " starts at tREFI " << opt.start_trefi[i] << "\n";
+        }
 
-            // decide if a workload is heavy
-            if (steady_state) {
-                for (int i = 0; i < num_channel; i++) {
-                    if (!donot_reset_signal[i]) { // if  reset in the last average_loop_count * average_loop_count do not reset any more
-                        int read_write[2] = {0};
-                        // read threshold
-                        if (((BW_average[(!phase) * (num_channel * 2) + i * 2 + 0] * READ_REL_MARGIN) < BW[i * 2 + 0]) && (READ_ABS_MARGIN < BW[i * 2 + 0])) {
-                            read_write[0] = 1;
-                        }
-                        // write threshold
-                        if (((BW_average[(!phase) * (num_channel * 2) + i * 2 + 1] * WRITE_REL_MARGIN) < BW[i * 2 + 1]) && (WRITE_ABS_MARGIN < BW[i * 2 + 0])) {
-                            read_write[1] = 1;
-                        }
-                        if (read_write[0] + read_write[1] > 0) {
-                            cout << "Reset for Channel " << i << endl << endl;
-                            reset_signal[i] = 1;
-                            donot_reset_signal[i] = 1;
-                        }
-                    }
-                }
-            }
-#endif
+        // saved periodically and on SIGINT/SIGTERM, so a restart resumes
+        if (!cfg.checkpoint.empty()) {
+            opt.on_checkpoint = [&](const Checkpoint &ckpt) {
+                string why;
+                if (!ckpt.save(cfg.checkpoint, &why))
+                    std::cerr << " checkpoint failed: " << why << "\n";
+            };
+            opt.stop = &stop_requested;
+            struct sigaction sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = on_stop;
+            sigaction(SIGINT, &sa, NULL);
+            sigaction(SIGTERM, &sa, NULL);
+        }
 
-            if (num_channel == 1) {
-                ch_thermal = ch_a_thermal;
-                ch_err = ch_a_err;
-                pre_a_err_r1_val = ch_err_r1_val;
-                pre_a_err_r0_val = ch_err_r0_val;
-                pre_err_r1_val = pre_a_err_r1_val;
-                pre_err_r0_val = pre_a_err_r0_val;
-                pre_a_err_det_r1 = err_det_r1;
-                pre_a_err_det_r0 = err_det_r0;
-                err_det_r1 = pre_a_err_det_r1;
-                err_det_r0 = pre_a_err_det_r0;
-#ifdef BW_STUFF
-                if (reset_signal[0]) {
-                    //ch_thermal.read32(tREFI_off, &ch_tref_reg);
-                    //ch_trefi_val = ch_tref_reg & 0x7fff;
-                    ch_trefi_val = base_tREFI;
-                    ch_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
-                }
-#endif
-            } else {
-                if (channel == 0) { // Channel A
-                    ch_thermal = ch_a_thermal;
-                    ch_err = ch_a_err;
-                    pre_d_err_r1_val = ch_err_r1_val;
-                    pre_d_err_r0_val = ch_err_r0_val;
-                    pre_err_r1_val = pre_a_err_r1_val;
-                    pre_err_r0_val = pre_a_err_r0_val;
-                    pre_d_err_det_r1 = err_det_r1;
-                    pre_d_err_det_r0 = err_det_r0;
-                    err_det_r1 = pre_a_err_det_r1;
-                    err_det_r0 = pre_a_err_det_r0;
-                    std::cout << " Channel A Register Value."
-                              << "\n\n";
-#ifdef BW_STUFF
-                    if (reset_signal[0]) {
-                        ch_thermal.read32(tREFI_off, &ch_tref_reg);
-                        ch_trefi_val = ch_tref_reg & 0x7fff;
-                        ch_trefi_val = ch_trefi_val / 2;
-                        ch_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
-                    }
-#endif
-                } else if (channel == 1) { // Channel B
-                    ch_thermal = ch_b_thermal;
-                    ch_err = ch_b_err;
-                    pre_a_err_r1_val = ch_err_r1_val;
-                    pre_a_err_r0_val = ch_err_r0_val;
-                    pre_err_r1_val = pre_b_err_r1_val;
-                    pre_err_r0_val = pre_b_err_r0_val;
-                    pre_a_err_det_r1 = err_det_r1;
-                    pre_a_err_det_r0 = err_det_r0;
-                    err_det_r1 = pre_b_err_det_r1;
-                    err_det_r0 = pre_b_err_det_r0;
-                    std::cout << " Channel B Register Value."
-                              << "\n\n";
-#ifdef BW_STUFF
-                    if (reset_signal[1]) {
-                        ch_thermal.read32(tREFI_off, &ch_tref_reg);
-                        ch_trefi_val = ch_tref_reg & 0x7fff;
-                        ch_trefi_val = ch_trefi_val / 2;
-                        ch_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
-                    }
-#endif
-                } else if (channel == 2) { // Channel C
-                    ch_thermal = ch_c_thermal;
-                    ch_err = ch_c_err;
-                    pre_b_err_r1_val = ch_err_r1_val;
-                    pre_b_err_r0_val = ch_err_r0_val;
-                    pre_err_r1_val = pre_c_err_r1_val;
-                    pre_err_r0_val = pre_c_err_r0_val;
-                    pre_b_err_det_r1 = err_det_r1;
-                    pre_b_err_det_r0 = err_det_r0;
-                    err_det_r1 = pre_c_err_det_r1;
-                    err_det_r0 = pre_c_err_det_r0;
-                    std::cout << " Channel C Register Value."
-                              << "\n\n";
-#ifdef BW_STUFF
-                    if (reset_signal[2]) {
-                        ch_thermal.read32(tREFI_off, &ch_tref_reg);
-                        ch_trefi_val = ch_tref_reg & 0x7fff;
-                        ch_trefi_val = ch_trefi_val / 2;
-                        ch_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
-                    }
-#endif
-                } else if (channel == 3) { // Channel D
-                    ch_thermal = ch_d_thermal;
-                    ch_err = ch_d_err;
-                    pre_c_err_r1_val = ch_err_r1_val;
-                    pre_c_err_r0_val = ch_err_r0_val;
-                    pre_err_r1_val = pre_d_err_r1_val;
-                    pre_err_r0_val = pre_d_err_r0_val;
-                    pre_c_err_det_r1 = err_det_r1;
-                    pre_c_err_det_r0 = err_det_r0;
-                    err_det_r1 = pre_d_err_det_r1;
-                    err_det_r0 = pre_d_err_det_r0;
-                    std::cout << " Channel D Register Value."
-                              << "\n\n";
-#ifdef BW_STUFF
-                    if (reset_signal[3]) {
-                        ch_thermal.read32(tREFI_off, &ch_tref_reg);
-                        ch_trefi_val = ch_tref_reg & 0x7fff;
-                        ch_trefi_val = ch_trefi_val / 2;
-                        ch_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
-                    }
-#endif
-                } else {
-                    channel = 0;
-                }
+        // sample records are written by a background thread, never by the control loop
+        Telemetry telemetry(backend.topology(), format, out);
+        telemetry.start(opt.base_trefi);
+        opt.telemetry = &telemetry;
+
+        // scrapes are answered by the server thread from the metrics block
+        ControllerMetrics metrics(backend.topology());
+        MetricsServer server(metrics);
+        if (!endpoint.empty()) {
+            if (!server.start(endpoint, &err)) {
+                std::cerr << err << "\n";
+                return 1;
             }
+            opt.metrics = &metrics;
+            std::cout << " metrics on " << endpoint << "\n";
+        }
 
-            ch_thermal.read32(temp_off, &ch_temp_reg);
-            ch_temp_val = ch_temp_reg & 0xff;
-
-            std::cout << std::dec << std::showbase;
-            std::cout << " Channel temp. : " << ch_temp_val << "\n\n";
-
-            if (ch_temp_val < 5)
-                tREFI_limit = temp_offset - temp_slope * 5;
-            else if (ch_temp_val > 85)
-                tREFI_limit = temp_offset - temp_slope * 85;
-            else
-                tREFI_limit = temp_offset - temp_slope * ch_temp_val;
-
-            ch_err.read32(err_cnt_off, &ch_err_reg);
-
-            ch_r1_ovrflw = (ch_err_reg >> 31) & 0x1;
-            ch_err_r1_val = (ch_err_reg >> 16) & 0x7fff;
-            ch_r0_ovrflw = (ch_err_reg >> 15) & 0x1;
-            ch_err_r0_val = ch_err_reg & 0x00007fff;
-
-            std::cout << " Rank 1 overflow : " << ch_r1_ovrflw << " , Rank 0 overflow : " << ch_r0_ovrflw << "\n";
-            std::cout << " Rank 1 err count : " << ch_err_r1_val << " , Rank 0 err count : " << ch_err_r1_val << "\n\n";
-
-            ch_thermal.read32(tREFI_off, &ch_tref_reg);
-            ch_trefi_val = ch_tref_reg & 0x7fff;
-
-            std::cout << " 1866 => tck = 1.072ns"
-                      << "\n";
-            std::cout << " Previous Channel tREFI(ck) : " << ch_trefi_val << ", ";
-
-            if (((ch_r1_ovrflw + ch_r0_ovrflw) == 0) & (pre_err_r1_val >= ch_err_r1_val) & (pre_err_r0_val >= ch_err_r0_val)) { // if no error
-                if ((err_det_r1 == false) & (err_det_r0 == false)) {                                                            // if no error, increase trefI
-
-                    std::cout << "\n No err!!! \n ";
-                    if (ch_trefi_val < tREFI_limit - 16) { //  tREFI max
-                        ch_trefi_val = ch_trefi_val + step_tREFI_inc;
-                    } else {
-                        ch_trefi_val = tREFI_limit;
-                        // std::cout << ", tREFI limit!!!!! " << tREFI_limit <<", ";
-                    }
-                } else if ((pre_err_r1_val >= ch_err_r1_val) & err_det_r1) {
-                    err_det_r1 = false;
-                    ch_trefi_val = ch_trefi_val - (step_tREFI_dec << 1);
-                    std::cout << "\n err_det_r1 : 1 -> 0 \n ";
-                    //ch_err.write32(err_cnt_off, ch_err_reg&0x7fffffff);
-                } else if ((pre_err_r0_val >= ch_err_r0_val) & err_det_r0) {
-                    err_det_r0 = false;
-                    ch_trefi_val = ch_trefi_val - (step_tREFI_dec << 1);
-                    std::cout << "\n err_det_r0 : 1 -> 0 \n ";
-                    //ch_err.write32(err_cnt_off, ch_err_reg&0xffff7fff);
-                } else {
-                    ch_trefi_val = ch_trefi_val - (step_tREFI_dec << 1);
-                }
-                if (ch_trefi_val < 0.5 * base_tREFI) {
-                    ch_trefi_val = 0.5 * base_tREFI;
-                }
-                ch_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
-            } else { // if error
-                if (ch_r1_ovrflw || (pre_err_r1_val < ch_err_r1_val)) {
-                    err_det_r1 = true;
-                    std::cout << "\n detect err at r1 !!!\n ";
-                }
-                if (ch_r0_ovrflw || (pre_err_r0_val < ch_err_r0_val)) {
-                    err_det_r0 = true;
-                    std::cout << "\n detect err at r0 !!!\n ";
-                }
-                ch_trefi_val = ch_trefi_val - (step_tREFI_dec << 1);
-                if (ch_trefi_val < 0.5 * base_tREFI) {
-                    ch_trefi_val = 0.5 * base_tREFI;
-                }
-                ch_thermal.write32(tREFI_off, ch_tref_const + ch_trefi_val);
+        // the loop times itself, SIGUSR1 prints the histograms
+        OverheadStats overhead(backend.topology());
+        backend.setOverhead(&overhead);
+        opt.overhead = &overhead;
+        opt.dump = &dump_requested;
+        // refresh duty cycle and the bandwidth it gives back, printed with the histograms
+        DramTiming timing;
+        apply_config(cfg, &timing);
+        RefreshAccounting refresh(backend.topology(), opt.base_trefi, timing);
+        opt.refresh = &refresh;
+
+        ControllerStats stats;
+        opt.on_dump = [&]() {
+            overhead.dump(stderr);
+            std::cerr << " " << stats.deadline_misses << " deadline misses in " << stats.ticks << " ticks\n";
+            refresh.report(std::cerr);
+        };
+        sa.sa_handler = on_sigusr1;
+        sigaction(SIGUSR1, &sa, NULL);
+
+        // last, so the telemetry and metrics threads keep the normal scheduler
+        if (rt.priority > 0 || rt.cpu >= 0 || rt.lock_memory) {
+            if (!enter_rt_mode(rt, &err)) {
+                std::cerr << " real-time mode: " << err << "\n";
+                return 1;
             }
-
-            std::cout << " Present Channel tREFI(ck) : " << ch_trefi_val << "\n\n ";
-
-            if (channel < num_channel - 1)
-                channel++;
-            else
-                channel = 0;
-
-            usleep(LOOP_SLEEP);
+            std::cout << " real-time mode, SCHED_FIFO priority " << rt.priority << ", cpu " << rt.cpu << "\n";
         }
+
+        run_controller(backend, opt, &stats);
+        opt.on_dump();
     } catch (std::exception &e) {
         std::cerr << "Error accessing registers: " << e.what() << "\n";
         std::cerr << "Please check if the program can access MSR/PCICFG drivers.\n";
@@ -0,0 +1,208 @@
+// Memory bandwidth/latency benchmark at two tREFI settings
+//
+// usage: dynamicRefresh-bench [-n] [-r trefi] [-b trefi] [-C config] [-D smbios_dir] [-N nodes] [-t threads] [-m MB] [-l MB] [-i reps] [-c Mloads] [-w ms]
+//
+// Runs the kernels of bench.h once with the base tREFI and once with the
+// held tREFI written to every channel, and reports the difference. The base
+// is 7.8 us at the DRAM clock found the way the daemon finds it (timing.h),
+// or the base_trefi of the daemon's config. Stop the
+// daemon first, both write the same registers. -n leaves the registers
+// alone and runs both passes as they are, which shows the run to run noise
+// and works on any Linux box.
+
+#ifdef DYNAMICREFRESH_HAVE_PCM
+#define PCM_USE_PCI_MM_LINUX
+#endif
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "address.h"
+#include "bench.h"
+#include "config.h"
+#include "register_backend.h"
+#include "timing.h"
+#ifdef DYNAMICREFRESH_HAVE_PCM
+#include "pcm_backend.h"
+#endif
+
+using namespace std;
+
+static void print_usage(const char *prog) {
+    cout << "usage: " << prog << " [-n] [-r trefi] [-b trefi] [-C config] [-D smbios_dir] [-N nodes] [-t threads] [-m MB] [-l MB] [-i reps] [-c Mloads] [-w ms]\n";
+    cout << "  -n           do not touch the iMC registers, run both passes as the system is\n";
+    cout << "  -r trefi     tREFI to hold for the second pass (default: what the channels have now)\n";
+    cout << "  -b trefi     tREFI of the base pass (default: 7.8 us at the discovered DRAM clock)\n";
+    cout << "  -C config    the daemon's configuration, for its base_trefi and checkpoint\n";
+    cout << "  -D dir       SMBIOS entries for the DRAM clock (default " SMBIOS_ENTRIES ", empty for none)\n";
+    cout << "  -N nodes     NUMA nodes to run on, e.g. 0,1 (default all)\n";
+    cout << "  -t threads   STREAM threads per node (default one per CPU)\n";
+    cout << "  -m MB        STREAM array size per thread (default 64)\n";
+    cout << "  -l MB        pointer chase buffer per node (default 256)\n";
+    cout << "  -i reps      STREAM repetitions, the best counts (default 5)\n";
+    cout << "  -c Mloads    pointer chase loads per node in millions (default 20)\n";
+    cout << "  -w ms        settle time after writing tREFI (default 100)\n";
+}
+
+static void print_result(const char *label, const BenchResult &r) {
+    printf(" %-26s", label);
+    for (int k = 0; k < NUM_STREAM_KERNELS; k++)
+        printf(" %s %9.0f MB/s", stream_kernel_name(k), r.stream_mbps[k]);
+    printf(", latency p50 %6.1f ns p99 %6.1f ns mean %6.1f ns\n", r.latency_p50_ns, r.latency_p99_ns, r.latency_mean_ns);
+}
+
+static double delta(double base, double held) { return base > 0 ? (held - base) / base * 100 : 0; }
+
+int main(int argc, char *argv[]) {
+    BenchOptions opt;
+    bool registers = true;
+    uint32_t held = 0, base_trefi = 0;
+    string config_path, smbios_dir = SMBIOS_ENTRIES;
+    string nodes;
+    unsigned settle_ms = 100;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0)
+            registers = false;
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            held = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            base_trefi = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc)
+            config_path = argv[++i];
+        else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc)
+            smbios_dir = argv[++i];
+        else if (strcmp(argv[i], "-N") == 0 && i + 1 < argc)
+            nodes = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            opt.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            opt.stream_bytes = strtoull(argv[++i], NULL, 0) << 20;
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            opt.chase_bytes = strtoull(argv[++i], NULL, 0) << 20;
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+            opt.reps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            opt.chase_loads = strtoull(argv[++i], NULL, 0) * 1000000;
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            settle_ms = strtoul(argv[++i], NULL, 0);
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.reps <= 0 || opt.threads < 0 || opt.stream_bytes == 0 || opt.chase_bytes == 0 || held > 0x7fff || base_trefi > 0x7fff) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const vector<vector<int>> all = numa_cpu_sets();
+    if (nodes.empty()) {
+        opt.cpu_sets = all;
+    } else {
+        vector<int> ids;
+        if (!parse_cpu_list(nodes, &ids)) {
+            cerr << "bad node list " << nodes << "\n";
+            return 1;
+        }
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (ids[i] >= (int)all.size()) {
+                cerr << "no NUMA node " << ids[i] << "\n";
+                return 1;
+            }
+            opt.cpu_sets.push_back(all[ids[i]]);
+        }
+    }
+    cout << " " << max<size_t>(opt.cpu_sets.size(), 1) << " node(s), " << (opt.stream_bytes >> 20) << " MB STREAM arrays, " << (opt.chase_bytes >> 20)
+         << " MB pointer chase\n";
+
+    std::unique_ptr<RegisterBackend> backend;
+    if (registers) {
+#ifdef DYNAMICREFRESH_HAVE_PCM
+        try {
+            backend.reset(new PcmRegisterBackend(discover_topology()));
+        } catch (std::exception &e) {
+            cerr << "Error accessing registers: " << e.what() << ", -n runs without them\n";
+            return 1;
+        }
+#else
+        cerr << "built without PCM, only -n is available\n";
+        return 1;
+#endif
+    }
+
+    // the registers stay at the held tREFI while the kernels run, so a ^C
+    // waits for them to be restored
+    sigset_t block, old_mask;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigprocmask(SIG_BLOCK, &block, &old_mask);
+
+    vector<uint32_t> saved;
+    uint32_t held_trefi = held;
+    if (backend) {
+        saved.resize(backend->numChannels());
+        for (int i = 0; i < backend->numChannels(); i++)
+            backend->read32(i, REG_TREFI, &saved[i]);
+        if (held_trefi == 0 && !saved.empty())
+            held_trefi = saved[0] & 0x7fff;
+
+        // the base the daemon would use: discovered timing under the
+        // config's keys, -b still wins
+        RefreshConfig probe, defaults, cfg;
+        string err;
+        const ClockFallback fallback = load_config(config_path, vector<string>(), &probe, &err) ? clock_fallback(probe) : ClockFallback();
+        const vector<ChannelTiming> discovered = discover_timing(*backend, smbios_dir, fallback);
+        print_timing(cout, *backend, discovered);
+        apply_timing(discovered, &defaults);
+        if (!load_config(config_path, vector<string>(), &cfg, &err, &defaults)) {
+            cerr << err << "\n";
+            return 1;
+        }
+        if (base_trefi == 0)
+            base_trefi = cfg.base_trefi;
+        cout << " base tREFI(ck) " << base_trefi << (base_trefi == cfg.base_trefi ? "" : " (-b)") << ", DRAM clock " << cfg.dram_mts << " MT/s\n";
+    }
+    const auto set_trefi = [&](uint32_t trefi) {
+        if (!backend)
+            return;
+        for (int i = 0; i < backend->numChannels(); i++)
+            backend->write32(i, REG_TREFI, (saved[i] & 0xffff8000) + (trefi & 0x7fff));
+        usleep(settle_ms * 1000);
+    };
+
+    char label[64] = "pass 1";
+    set_trefi(base_trefi);
+    if (backend)
+        snprintf(label, sizeof(label), "base tREFI %u", base_trefi);
+    const BenchResult base = run_bench(opt);
+    print_result(label, base);
+
+    strcpy(label, "pass 2");
+    set_trefi(held_trefi);
+    if (backend)
+        snprintf(label, sizeof(label), "held tREFI %u", held_trefi);
+    const BenchResult run = run_bench(opt);
+    print_result(label, run);
+
+    if (backend) {
+        for (int i = 0; i < backend->numChannels(); i++)
+            backend->write32(i, REG_TREFI, saved[i]);
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+    printf(" %-26s", backend ? "held vs base" : "pass 2 vs 1, no registers");
+    for (int k = 0; k < NUM_STREAM_KERNELS; k++)
+        printf(" %s %+9.2f %%  ", stream_kernel_name(k), delta(base.stream_mbps[k], run.stream_mbps[k]));
+    printf(", latency p50 %+6.2f %%  p99 %+6.2f %%  mean %+6.2f %%\n", delta(base.latency_p50_ns, run.latency_p50_ns),
+           delta(base.latency_p99_ns, run.latency_p99_ns), delta(base.latency_mean_ns, run.latency_mean_ns));
+    return 0;
+}
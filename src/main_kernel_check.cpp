@@ -0,0 +1,117 @@
+// Checks errtrack_kernel() against the scalar reference errtrack_decide()
+//
+// usage: dynamicRefresh-kernel-check [-n ticks] [-s seed]
+//
+// Both run the same ticks from the same state, every output and every lane
+// of the state has to match bit for bit. The ticks cover random lanes, tREFI
+// and ceilings at the 15 bit limit, Q8 ceilings that are no multiple of 1/32
+// and channel counts that leave a partial last vector. Exits 1 on the first
+// mismatch.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "errtrack_kernel.h"
+
+using namespace std;
+
+static mt19937 rng;
+
+static int32_t uniform(int32_t lo, int32_t hi) { return uniform_int_distribution<int32_t>(lo, hi)(rng); }
+
+static ErrTrackParams random_params(bool edge) {
+    ErrTrackParams p;
+    p.step_inc = edge ? uniform(1, 0x7fff) : uniform(1, 512);
+    p.step_dec = edge ? uniform(0, 0x7fff) : uniform(0, 1024);
+    p.min_trefi = uniform(1, 0x7fff);
+    // any Q8 slope/offset, not just the exact multiples of 1/32 of the defaults
+    p.ceiling.slope = uniform(0, 0x7fff * 256 / 80);
+    p.ceiling.offset = edge ? uniform(0x7f00 * 256, 0xffff * 256) : uniform(0, 0xffff * 256);
+    p.ceiling.temp_min = uniform(0, 60);
+    p.ceiling.temp_max = uniform(p.ceiling.temp_min, 255);
+    return p;
+}
+
+static int32_t random_trefi(bool edge) { return edge ? 0x7fff - uniform(0, 64) : uniform(0, 0x7fff); }
+
+static bool same(const char *what, size_t lane, int32_t scalar, int32_t kernel) {
+    if (scalar == kernel)
+        return true;
+    cerr << "mismatch in " << what << " of lane " << lane << ": scalar " << scalar << ", kernel " << kernel << "\n";
+    return false;
+}
+
+// one tick with channels lanes, false on a mismatch
+static bool check_tick(int channels, bool edge, ErrTrackState *ref, ErrTrackState *vec, const ErrTrackParams &p) {
+    ErrTrackLanes l;
+    l.resize(channels);
+    vector<int32_t> out(channels), limit(channels), reason(channels);
+    for (int i = 0; i < channels; i++) {
+        l.due[i] = uniform(0, 3) != 0;
+        l.temp[i] = uniform(0, 255);
+        // mostly the previous counters so lanes climb, sometimes new errors or a cleared counter
+        const int e = uniform(0, 7);
+        l.err_r0[i] = e == 0 ? uniform(0, 0x7fff) : ref->pre_err_r0[i];
+        l.err_r1[i] = e == 1 ? uniform(0, 0x7fff) : ref->pre_err_r1[i];
+        l.ovf_r0[i] = uniform(0, 31) == 0;
+        l.ovf_r1[i] = uniform(0, 31) == 0;
+        l.trefi[i] = random_trefi(edge);
+        l.target[i] = uniform(0, 1) ? l.trefi[i] : random_trefi(edge);
+        if (l.due[i])
+            out[i] = errtrack_decide(p, ref, i, l.temp[i], l.err_r0[i], l.err_r1[i], l.ovf_r0[i] != 0, l.ovf_r1[i] != 0, l.trefi[i], l.target[i], &limit[i], &reason[i]);
+    }
+    errtrack_kernel(p, vec, &l);
+
+    for (int i = 0; i < channels; i++) {
+        if (l.due[i] && !(same("tREFI", i, out[i], l.out_trefi[i]) && same("limit", i, limit[i], l.out_limit[i]) && same("reason", i, reason[i], l.out_reason[i])))
+            return false;
+        if (l.due[i] && out[i] > 0x7fff && !same("15 bit tREFI", i, 0x7fff, out[i]))
+            return false;
+        if (!(same("pre_err_r0", i, ref->pre_err_r0[i], vec->pre_err_r0[i]) && same("pre_err_r1", i, ref->pre_err_r1[i], vec->pre_err_r1[i]) &&
+              same("err_det_r0", i, ref->err_det_r0[i], vec->err_det_r0[i]) && same("err_det_r1", i, ref->err_det_r1[i], vec->err_det_r1[i])))
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t ticks = 20000;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            ticks = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            seed = strtoul(argv[++i], NULL, 0);
+        else {
+            cerr << "usage: " << argv[0] << " [-n ticks] [-s seed]\n";
+            return 1;
+        }
+    }
+    rng.seed(seed);
+
+    // full vectors, partial last vectors and fewer channels than one vector
+    static const int sizes[] = {1, 3, ERRTRACK_LANES - 1, ERRTRACK_LANES, ERRTRACK_LANES + 1, 2 * ERRTRACK_LANES + 5, 64};
+    uint64_t lanes = 0;
+    for (uint64_t t = 0; t < ticks;) {
+        const int channels = sizes[uniform(0, sizeof(sizes) / sizeof(sizes[0]) - 1)];
+        const bool edge = uniform(0, 3) == 0;
+        const ErrTrackParams p = random_params(edge);
+        ErrTrackState ref, vec;
+        ref.resize(channels);
+        vec.resize(channels);
+        // a run of ticks carries the error state from one to the next
+        for (int run = 0; run < 16 && t < ticks; run++, t++) {
+            if (!check_tick(channels, edge, &ref, &vec, p)) {
+                cerr << "seed " << seed << ", tick " << t << ", " << channels << " channels" << (edge ? ", edge case" : "") << "\n";
+                return 1;
+            }
+            lanes += channels;
+        }
+    }
+    cout << " " << ticks << " ticks, " << lanes << " lanes, kernel matches the scalar reference\n";
+    return 0;
+}
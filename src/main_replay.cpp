@@ -0,0 +1,133 @@
+// Feeds a recorded binary trace through the controller at full speed
+//
+// usage: dynamicRefresh-replay trace.bin [-v] [-f format] [-o file] [-C config] [-p policy] [-P key=value] [-L profile]
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "controller.h"
+#include "config.h"
+#include "policy.h"
+#include "replay_backend.h"
+#include "telemetry.h"
+#include "trace.h"
+
+using namespace std;
+
+static void print_usage(const char *prog) {
+    cout << "usage: " << prog << " trace.bin [-v] [-f format] [-o file] [-C config] [-p policy] [-P key=value] [-L profile]\n";
+    cout << "  trace.bin    binary trace written with -f binary by the daemon or the simulator\n";
+    cout << "  -v           record every replayed controller sample (to stdout unless -o is given)\n";
+    cout << "  -f format    sample record format: text (default), csv or binary\n";
+    cout << "  -o file      write the sample records to file, implies -v\n";
+    cout << "  -p policy    refresh policy under test: " << policy_names() << " (default temp-slope)\n";
+    cout << "  -C config    configuration file of key = value lines, see config.h\n";
+    cout << "  -P key=value override a configuration key, repeatable\n";
+    cout << "  -L profile   start the channels from a retention profile, same as -P profile=file\n";
+}
+
+int main(int argc, char *argv[]) {
+    const char *trace_path = NULL;
+    string out_path;
+    bool verbose = false;
+    TelemetryFormat format = TELEMETRY_TEXT;
+    string config_path;
+    vector<string> overrides;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0)
+            verbose = true;
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc && parse_telemetry_format(argv[i + 1], &format))
+            i++;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+            verbose = true;
+        } else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc)
+            config_path = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            overrides.push_back(string("policy=") + argv[++i]);
+        else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc)
+            overrides.push_back(argv[++i]);
+        else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc)
+            overrides.push_back(string("profile=") + argv[++i]);
+        else if (argv[i][0] != '-' && trace_path == NULL)
+            trace_path = argv[i];
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (trace_path == NULL) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    TraceFile trace;
+    string err;
+    if (!trace.open(trace_path, &err)) {
+        cerr << trace_path << ": " << err << "\n";
+        return 1;
+    }
+
+    // base_trefi defaults to the one the trace was recorded with
+    RefreshConfig defaults, cfg;
+    if (trace.header().base_trefi)
+        defaults.base_trefi = trace.header().base_trefi;
+    if (!load_config(config_path, overrides, &cfg, &err, &defaults)) {
+        cerr << err << "\n";
+        return 1;
+    }
+    std::unique_ptr<RefreshPolicy> policy(make_policy(cfg, &err));
+    if (!policy) {
+        cerr << err << "\n";
+        return 1;
+    }
+
+    ReplayBackend backend(trace);
+    FILE *out = stdout;
+    if (!out_path.empty() && (out = fopen(out_path.c_str(), format == TELEMETRY_BINARY ? "wb" : "w")) == NULL) {
+        cerr << "can not open " << out_path << "\n";
+        return 1;
+    }
+    Telemetry telemetry(backend.topology(), format, out);
+
+    ControllerOptions opt;
+    apply_config(cfg, &opt);
+    if (!apply_profile(cfg, backend, &opt, &err)) {
+        cerr << err << "\n";
+        return 1;
+    }
+    opt.max_time_us = backend.endUs() - backend.startUs();
+    opt.policy = policy.get();
+    if (verbose) {
+        telemetry.start(opt.base_trefi);
+        opt.telemetry = &telemetry;
+    }
+
+    ControllerStats stats;
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    run_controller(backend, opt, &stats);
+    const double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    telemetry.stop();
+    if (out != stdout)
+        fclose(out);
+
+    cout << " Replayed " << backend.replayed() << " of " << trace.size() << " records, " << (backend.endUs() - backend.startUs()) / 1e6
+         << " s of trace in " << wall << " s, policy " << policy->name() << "\n";
+    for (int i = 0; i < backend.numChannels(); i++) {
+        const ChannelStats &cs = stats.channels[i];
+        const ReplayChannelStats &rs = backend.stats(i);
+        const uint64_t recorded = rs.recorded_samples ? rs.recorded_trefi_sum / rs.recorded_samples : 0;
+        const uint64_t replayed = cs.samples ? cs.trefi_sum / cs.samples : 0;
+        cout << " " << channel_name(backend.location(i)) << ": recorded avg tREFI(ck) " << recorded << ", replayed avg tREFI(ck) " << replayed
+             << ", errors seen " << rs.errors_seen << ", errors avoided " << rs.errors_avoided << ", err events " << cs.err_events
+             << ", writes " << cs.writes << " (" << cs.writes_avoided << " avoided)\n";
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+// Runs the tREFI controller against the simulated DIMM backend
+//
+// usage: dynamicRefresh-sim [-t ticks] [-S sockets] [-M imcs] [-c channels] [-s seed] [-b bw_trace.csv] [-v] [-f format] [-o file] [-C config] [-p policy] [-P key=value] [-L profile] [-X profile] [-e endpoint] [-O] [-A]
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "characterize.h"
+#include "checkpoint.h"
+#include "controller.h"
+#include "config.h"
+#include "metrics.h"
+#include "overhead.h"
+#include "policy.h"
+#include "profile.h"
+#include "sim_backend.h"
+#include "telemetry.h"
+
+using namespace std;
+
+static void print_usage(const char *prog) {
+    cout << "usage: " << prog << " [-t ticks] [-S sockets] [-M imcs] [-c channels] [-s seed] [-b bw_trace.csv] [-v] [-f format] [-o file] [-C config] [-p policy] [-P key=value] [-L profile] [-X profile] [-e endpoint] [-O] [-A]\n";
+    cout << "  -t ticks     number of controller ticks to simulate (default 100000)\n";
+    cout << "  -S sockets   number of simulated sockets (default 1)\n";
+    cout << "  -M imcs      memory controllers per socket (default 1)\n";
+    cout << "  -c channels  channels per memory controller (default 4)\n";
+    cout << "  -s seed      random seed of the DIMM model (default 1)\n";
+    cout << "  -b file      bandwidth trace, csv lines time_ms,channel,read_mbps,write_mbps\n";
+    cout << "  -v           record every controller sample (to stdout unless -o is given)\n";
+    cout << "  -f format    sample record format: text (default), csv or binary\n";
+    cout << "  -o file      write the sample records to file, implies -v\n";
+    cout << "  -p policy    refresh policy: " << policy_names() << " (default temp-slope)\n";
+    cout << "  -C config    configuration file of key = value lines, see config.h\n";
+    cout << "  -P key=value override a configuration key, repeatable\n";
+    cout << "  -L profile   start the channels from a retention profile, same as -P profile=file\n";
+    cout << "  -X profile   characterize retention with tREFI sweeps (sweep_* keys) and write the profile\n";
+    cout << "  -O           time the control loop and print its latency and overhead histograms at the end\n";
+    cout << "  -A           account refresh duty cycle and reclaimed bandwidth, printed per channel, socket and host at the end\n";
+    cout << "  -e endpoint  serve Prometheus metrics on [host:]port or a Unix socket path while simulating\n";
+}
+
+static int characterize(SimRegisterBackend &backend, const RefreshConfig &cfg, const string &path) {
+    CharacterizeOptions copt;
+    apply_config(cfg, &copt);
+    RetentionProfile profile;
+    CharacterizeStats stats;
+    run_characterization(backend, copt, &profile, &stats);
+    string err;
+    if (!profile.save(path, &err)) {
+        cerr << err << "\n";
+        return 1;
+    }
+
+    cout << " Characterized " << backend.numChannels() << " channels in " << stats.steps << " steps (" << backend.nowUs() / 1e6 << " s), profile "
+         << path << "\n";
+    for (int i = 0; i < backend.numChannels(); i++) {
+        const SimDimmParams &p = backend.params(i);
+        const double temp = backend.temperature(i);
+        cout << " " << channel_name(backend.location(i)) << ": failures " << stats.failures[i] << ", clean sweeps " << stats.clean[i]
+             << ", temp " << temp << ", safe tREFI(ck) " << profile.safeTrefi(backend.location(i), temp, cfg.profile_margin)
+             << ", model retention(ck) " << (uint32_t)(min(p.retention[0], p.retention[1]) * pow(2.0, (45.0 - temp) / 10.0)) << "\n";
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    ControllerOptions opt;
+    opt.max_ticks = 100000;
+    int sockets = 1, imcs = 1, channels = 4;
+    uint32_t seed = 1;
+    string trace, out_path;
+    bool verbose = false, timed = false, accounted = false;
+    TelemetryFormat format = TELEMETRY_TEXT;
+    string config_path, profile_out, endpoint;
+    vector<string> overrides;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            opt.max_ticks = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc)
+            sockets = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc)
+            imcs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            channels = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            seed = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            trace = argv[++i];
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose = true;
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc && parse_telemetry_format(argv[i + 1], &format))
+            i++;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+            verbose = true;
+        } else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc)
+            config_path = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            overrides.push_back(string("policy=") + argv[++i]);
+        else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc)
+            overrides.push_back(argv[++i]);
+        else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc)
+            overrides.push_back(string("profile=") + argv[++i]);
+        else if (strcmp(argv[i], "-X") == 0 && i + 1 < argc)
+            profile_out = argv[++i];
+        else if (strcmp(argv[i], "-O") == 0)
+            timed = true;
+        else if (strcmp(argv[i], "-A") == 0)
+            accounted = true;
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            endpoint = argv[++i];
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (sockets <= 0 || imcs <= 0 || channels <= 0) {
+        cerr << "need at least one socket, memory controller and channel\n";
+        return 1;
+    }
+
+    RefreshConfig cfg;
+    string err;
+    if (!load_config(config_path, overrides, &cfg, &err)) {
+        cerr << err << "\n";
+        return 1;
+    }
+    std::unique_ptr<RefreshPolicy> policy(make_policy(cfg, &err));
+    if (!policy) {
+        cerr << err << "\n";
+        return 1;
+    }
+    apply_config(cfg, &opt);
+    opt.policy = policy.get();
+
+    SimRegisterBackend backend(make_topology(sockets, imcs, channels), seed);
+    if (!trace.empty() && !backend.loadBandwidthTrace(trace)) {
+        cerr << "can not read bandwidth trace " << trace << "\n";
+        return 1;
+    }
+    if (!profile_out.empty())
+        return characterize(backend, cfg, profile_out);
+    if (!apply_profile(cfg, backend, &opt, &err)) {
+        cerr << err << "\n";
+        return 1;
+    }
+    int resumed = 0;
+    if (!apply_checkpoint(cfg, backend, &opt, &resumed, &err))
+        cerr << "ignoring checkpoint: " << err << "\n";
+    else if (resumed)
+        cout << " resumed " << resumed << " channels from " << cfg.checkpoint << "\n";
+    if (!cfg.checkpoint.empty()) {
+        opt.on_checkpoint = [&](const Checkpoint &ckpt) {
+            string why;
+            if (!ckpt.save(cfg.checkpoint, &why))
+                cerr << why << "\n";
+        };
+    }
+
+    FILE *out = stdout;
+    if (!out_path.empty() && (out = fopen(out_path.c_str(), format == TELEMETRY_BINARY ? "wb" : "w")) == NULL) {
+        cerr << "can not open " << out_path << "\n";
+        return 1;
+    }
+    Telemetry telemetry(backend.topology(), format, out);
+    if (verbose) {
+        telemetry.start(opt.base_trefi);
+        opt.telemetry = &telemetry;
+    }
+
+    ControllerMetrics metrics(backend.topology());
+    MetricsServer server(metrics);
+    if (!endpoint.empty()) {
+        if (!server.start(endpoint, &err)) {
+            cerr << err << "\n";
+            return 1;
+        }
+        opt.metrics = &metrics;
+    }
+
+    OverheadStats overhead(backend.topology());
+    if (timed)
+        opt.overhead = &overhead;
+
+    DramTiming timing;
+    apply_config(cfg, &timing);
+    RefreshAccounting refresh(backend.topology(), opt.base_trefi, timing);
+    if (accounted)
+        opt.refresh = &refresh;
+
+    ControllerStats stats;
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    run_controller(backend, opt, &stats);
+    const double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    telemetry.stop();
+    if (out != stdout)
+        fclose(out);
+
+    cout << " Simulated " << stats.ticks << " ticks (" << backend.nowUs() / 1e6 << " s) in " << wall << " s, " << (wall > 0 ? stats.ticks / wall : 0)
+         << " ticks/s, policy " << policy->name() << "\n";
+    for (int i = 0; i < backend.numChannels(); i++) {
+        const ChannelStats &cs = stats.channels[i];
+        uint32_t trefi = 0;
+        backend.read32(i, REG_TREFI, &trefi);
+        cout << " " << channel_name(backend.location(i)) << ": samples " << cs.samples << ", avg tREFI(ck) " << (cs.samples ? cs.trefi_sum / cs.samples : 0) << ", final tREFI(ck) " << (trefi & 0x7fff)
+             << ", temp " << backend.temperature(i) << ", inc " << cs.increments << ", dec " << cs.decrements << ", err events " << cs.err_events
+             << ", writes " << cs.writes << " (" << cs.writes_avoided << " avoided)"
+             << ", injected errors " << backend.injectedErrors(i) << "\n";
+        if (const RankState *ranks = policy->ranks(i)) {
+            for (int r = 0; r < 2; r++)
+                cout << "   rank" << r << ": errors " << ranks[r].errors << ", fail tREFI(ck) " << (uint32_t)ranks[r].fail_trefi << ", model retention(ck) "
+                     << (uint32_t)backend.params(i).retention[r] << (policy->weakestRank(i) == r ? ", weakest" : "") << "\n";
+        }
+    }
+    if (telemetry.dropped())
+        cout << " " << telemetry.dropped() << " sample records dropped\n";
+    if (accounted) {
+        cout << " Refresh accounting against base tREFI(ck) " << opt.base_trefi << "\n";
+        refresh.report(cout);
+    }
+    if (timed) {
+        fflush(stdout);
+        overhead.dump(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,250 @@
+// Prometheus/OpenMetrics exporter, see metrics.h
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "metrics.h"
+
+#define METRICS_POLL_MS 100      // how often the server looks at running
+#define METRICS_REQUEST_MS 1000  // a client has this long to send its request
+#define METRICS_SEND_MS 1000     // and to take each chunk of the response
+#define METRICS_MAX_REQUEST 4096
+
+ChannelMetrics::ChannelMetrics()
+    : temp(0), trefi(0), limit(0), err_r0(0), err_r1(0), read_mbps(0), write_mbps(0), refresh_duty(0), reclaimed(0), reclaimed_mbps(0), gain_mbps(0), increments(0), decrements(0), err_events(0), bw_resets(0),
+      writes(0), writes_avoided(0) {}
+
+LatencyMetric::LatencyMetric() : count(0), sum_ns(0) {
+    for (int i = 0; i <= METRICS_LATENCY_BUCKETS; i++)
+        bucket[i].store(0, std::memory_order_relaxed);
+}
+
+void LatencyMetric::record(uint64_t ns) {
+    int b = 0;
+    while (b < METRICS_LATENCY_BUCKETS && ns > (uint64_t)1000 << b)
+        b++;
+    bucket[b].fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+ControllerMetrics::ControllerMetrics(const Topology &t) : ticks(0), deadline_misses(0), topo(t), channels(new ChannelMetrics[t.size()]) {}
+
+static void appendf(std::string *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string *out, const char *fmt, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    const int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        out->append(buf, std::min<size_t>(n, sizeof(buf) - 1));
+}
+
+// one metric family with a sample per channel
+template <typename Get>
+static void family(std::string *out, const Topology &topo, const char *name, const char *type, const char *help, Get get) {
+    appendf(out, "# HELP dynamicrefresh_%s %s\n# TYPE dynamicrefresh_%s %s\n", name, help, name, type);
+    for (size_t i = 0; i < topo.size(); i++)
+        appendf(out, "dynamicrefresh_%s{channel=\"%s\",socket=\"%u\",imc=\"%u\"} %.10g\n", name, channel_name(topo[i]).c_str(), topo[i].socket, topo[i].imc,
+                get(i));
+}
+
+std::string ControllerMetrics::render() const {
+    std::string out;
+    const std::memory_order r = std::memory_order_relaxed;
+    const ChannelMetrics *c = channels.get();
+
+    family(&out, topo, "temperature_celsius", "gauge", "DIMM temperature of the latest sample", [&](size_t i) { return (double)c[i].temp.load(r); });
+    family(&out, topo, "trefi_clocks", "gauge", "tREFI the policy chose last", [&](size_t i) { return (double)c[i].trefi.load(r); });
+    family(&out, topo, "trefi_limit_clocks", "gauge", "tREFI ceiling at the latest temperature", [&](size_t i) { return (double)c[i].limit.load(r); });
+    family(&out, topo, "rank0_error_count", "gauge", "rank 0 error counter register", [&](size_t i) { return (double)c[i].err_r0.load(r); });
+    family(&out, topo, "rank1_error_count", "gauge", "rank 1 error counter register", [&](size_t i) { return (double)c[i].err_r1.load(r); });
+    family(&out, topo, "read_mbps", "gauge", "read bandwidth, -1 for an inactive channel", [&](size_t i) { return (double)c[i].read_mbps.load(r); });
+    family(&out, topo, "write_mbps", "gauge", "write bandwidth, -1 for an inactive channel", [&](size_t i) { return (double)c[i].write_mbps.load(r); });
+    family(&out, topo, "refresh_duty_ratio", "gauge", "fraction of time the channel refreshes, tRFC / tREFI",
+           [&](size_t i) { return (double)c[i].refresh_duty.load(r); });
+    family(&out, topo, "refresh_reclaimed_ratio", "gauge", "fraction of time given back against base_trefi",
+           [&](size_t i) { return (double)c[i].reclaimed.load(r); });
+    family(&out, topo, "refresh_reclaimed_mbps", "gauge", "peak bandwidth times the reclaimed fraction",
+           [&](size_t i) { return (double)c[i].reclaimed_mbps.load(r); });
+    family(&out, topo, "refresh_gain_mbps", "gauge", "measured bandwidth gained by the reclaimed time",
+           [&](size_t i) { return (double)c[i].gain_mbps.load(r); });
+    family(&out, topo, "trefi_increments_total", "counter", "samples that raised tREFI", [&](size_t i) { return (double)c[i].increments.load(r); });
+    family(&out, topo, "trefi_decrements_total", "counter", "samples that lowered tREFI after an error",
+           [&](size_t i) { return (double)c[i].decrements.load(r); });
+    family(&out, topo, "error_events_total", "counter", "samples that detected new errors", [&](size_t i) { return (double)c[i].err_events.load(r); });
+    family(&out, topo, "bandwidth_resets_total", "counter", "tREFI halvings on a heavy bandwidth phase", [&](size_t i) { return (double)c[i].bw_resets.load(r); });
+    family(&out, topo, "register_writes_total", "counter", "tREFI register writes", [&](size_t i) { return (double)c[i].writes.load(r); });
+    family(&out, topo, "register_writes_avoided_total", "counter", "decisions that left the tREFI register as it was",
+           [&](size_t i) { return (double)c[i].writes_avoided.load(r); });
+
+    appendf(&out, "# HELP dynamicrefresh_ticks_total scheduler wakeups of the control loop\n# TYPE dynamicrefresh_ticks_total counter\n");
+    appendf(&out, "dynamicrefresh_ticks_total %llu\n", (unsigned long long)ticks.load(r));
+    appendf(&out, "# HELP dynamicrefresh_deadline_misses_total ticks that started later than deadline_miss_us after their deadline\n");
+    appendf(&out, "# TYPE dynamicrefresh_deadline_misses_total counter\n");
+    appendf(&out, "dynamicrefresh_deadline_misses_total %llu\n", (unsigned long long)deadline_misses.load(r));
+
+    const LatencyMetric &l = decision_latency;
+    appendf(&out, "# HELP dynamicrefresh_decision_latency_seconds register read to register write of one batch of channels\n");
+    appendf(&out, "# TYPE dynamicrefresh_decision_latency_seconds histogram\n");
+    uint64_t cumulative = 0;
+    for (int b = 0; b < METRICS_LATENCY_BUCKETS; b++) {
+        cumulative += l.bucket[b].load(r);
+        appendf(&out, "dynamicrefresh_decision_latency_seconds_bucket{le=\"%g\"} %llu\n", ((uint64_t)1 << b) / 1e6, (unsigned long long)cumulative);
+    }
+    cumulative += l.bucket[METRICS_LATENCY_BUCKETS].load(r);
+    appendf(&out, "dynamicrefresh_decision_latency_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)cumulative);
+    appendf(&out, "dynamicrefresh_decision_latency_seconds_sum %.9f\n", l.sum_ns.load(r) / 1e9);
+    appendf(&out, "dynamicrefresh_decision_latency_seconds_count %llu\n", (unsigned long long)l.count.load(r));
+    return out;
+}
+
+MetricsServer::MetricsServer(const ControllerMetrics &m) : metrics(m), listen_fd(-1), running(false), served(0) {}
+
+MetricsServer::~MetricsServer() { stop(); }
+
+static bool listen_unix(const std::string &path, int *fd, std::string *err) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        *err = "metrics socket path too long: " + path;
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    *fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(path.c_str()); // left behind by an earlier run
+    if (*fd < 0 || bind(*fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(*fd, 16) < 0) {
+        *err = "can not listen on " + path + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+static bool listen_tcp(const std::string &endpoint, int *fd, std::string *err) {
+    const size_t colon = endpoint.rfind(':');
+    const std::string host = colon == std::string::npos ? "localhost" : endpoint.substr(0, colon);
+    const std::string port = colon == std::string::npos ? endpoint : endpoint.substr(colon + 1);
+
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    const int rc = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res);
+    if (rc != 0) {
+        *err = "metrics endpoint " + endpoint + ": " + gai_strerror(rc);
+        return false;
+    }
+    for (struct addrinfo *a = res; a; a = a->ai_next) {
+        *fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        if (*fd < 0)
+            continue;
+        const int one = 1;
+        setsockopt(*fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(*fd, a->ai_addr, a->ai_addrlen) == 0 && listen(*fd, 16) == 0)
+            break;
+        close(*fd);
+        *fd = -1;
+    }
+    freeaddrinfo(res);
+    if (*fd < 0) {
+        *err = "can not listen on " + endpoint + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool MetricsServer::start(const std::string &endpoint, std::string *err) {
+    if (running.load())
+        return true;
+    const bool is_unix = endpoint.find('/') != std::string::npos;
+    if (!(is_unix ? listen_unix(endpoint, &listen_fd, err) : listen_tcp(endpoint, &listen_fd, err))) {
+        if (listen_fd >= 0)
+            close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    if (is_unix)
+        unix_path = endpoint;
+    running.store(true);
+    worker = std::thread(&MetricsServer::run, this);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (!running.exchange(false))
+        return;
+    worker.join();
+    close(listen_fd);
+    listen_fd = -1;
+    if (!unix_path.empty())
+        unlink(unix_path.c_str());
+}
+
+void MetricsServer::run() {
+    struct pollfd p = {listen_fd, POLLIN, 0};
+    while (running.load(std::memory_order_relaxed)) {
+        if (poll(&p, 1, METRICS_POLL_MS) <= 0)
+            continue;
+        const int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        serve(fd);
+        close(fd);
+    }
+}
+
+// non-blocking, a client that stops reading is dropped after METRICS_SEND_MS
+// instead of wedging the server once the socket buffer is full
+static bool send_all(int fd, const std::string &s) {
+    struct pollfd p = {fd, POLLOUT, 0};
+    for (size_t off = 0; off < s.size();) {
+        const ssize_t n = send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            if (poll(&p, 1, METRICS_SEND_MS) <= 0)
+                return false;
+            continue;
+        }
+        if (n <= 0)
+            return false;
+        off += n;
+    }
+    return true;
+}
+
+// one HTTP/1.0 request per connection, GET /metrics (or /)
+void MetricsServer::serve(int fd) {
+    std::string req;
+    char buf[512];
+    struct pollfd p = {fd, POLLIN, 0};
+    while (req.find("\r\n\r\n") == std::string::npos && req.find("\n\n") == std::string::npos && req.size() < METRICS_MAX_REQUEST) {
+        if (poll(&p, 1, METRICS_REQUEST_MS) <= 0)
+            return;
+        const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+            return;
+        req.append(buf, n);
+    }
+
+    if (req.compare(0, 13, "GET /metrics ") != 0 && req.compare(0, 6, "GET / ") != 0) {
+        send_all(fd, "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\n\r\nnot found\n");
+        return;
+    }
+    const std::string body = metrics.render();
+    char head[160];
+    snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", body.size());
+    if (send_all(fd, head) && send_all(fd, body))
+        served.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,86 @@
+// Prometheus/OpenMetrics exporter
+//
+// The control loop only stores into relaxed atomics of a ControllerMetrics
+// block. A MetricsServer thread owns the listening socket (TCP or Unix) and
+// renders the text exposition format on every scrape, so a slow or stuck
+// client never delays a decision. Reads and writes of a connection wait at
+// most a second each, so a stuck client also only holds up the server thread
+// briefly.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "topology.h"
+
+// gauges are the latest sample, counters only grow
+struct ChannelMetrics {
+    std::atomic<uint32_t> temp, trefi, limit;
+    std::atomic<uint32_t> err_r0, err_r1; // raw rank error counters of the register
+    std::atomic<float> read_mbps, write_mbps;
+    std::atomic<float> refresh_duty, reclaimed; // fractions of time, see accounting.h
+    std::atomic<float> reclaimed_mbps, gain_mbps;
+    std::atomic<uint64_t> increments, decrements, err_events, bw_resets;
+    std::atomic<uint64_t> writes, writes_avoided;
+
+    ChannelMetrics();
+};
+
+// latency with power of two buckets from 1 us to 2^(N-1) us and +Inf
+#define METRICS_LATENCY_BUCKETS 16
+
+struct LatencyMetric {
+    std::atomic<uint64_t> bucket[METRICS_LATENCY_BUCKETS + 1]; // not cumulative
+    std::atomic<uint64_t> count, sum_ns;
+
+    LatencyMetric();
+    void record(uint64_t ns);
+};
+
+class ControllerMetrics {
+  public:
+    explicit ControllerMetrics(const Topology &topo);
+
+    ChannelMetrics &channel(int i) { return channels[i]; }
+    const Topology &topology() const { return topo; }
+
+    std::atomic<uint64_t> ticks;
+    std::atomic<uint64_t> deadline_misses; // ticks later than deadline_miss_us
+    LatencyMetric decision_latency; // first register read to last register write of a batch
+
+    // text exposition format 0.0.4
+    std::string render() const;
+
+  private:
+    Topology topo;
+    std::unique_ptr<ChannelMetrics[]> channels;
+};
+
+class MetricsServer {
+  public:
+    explicit MetricsServer(const ControllerMetrics &metrics);
+    ~MetricsServer();
+
+    // "port" or "host:port" for TCP (localhost when no host is given), a path
+    // with a '/' for a Unix socket; false with the reason when it can not listen
+    bool start(const std::string &endpoint, std::string *err);
+    void stop();
+
+    uint64_t scrapes() const { return served.load(std::memory_order_relaxed); }
+
+  private:
+    void run();
+    void serve(int fd);
+
+    const ControllerMetrics &metrics;
+    int listen_fd;
+    std::string unix_path; // unlinked on stop
+    std::atomic<bool> running;
+    std::atomic<uint64_t> served;
+    std::thread worker;
+};
@@ -0,0 +1,187 @@
+// Per NUMA node refresh policies, see nodes.h
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nodes.h"
+
+NodePolicy::NodePolicy(const RefreshConfig &c) : cfg(c), label(c.policy + " per node") {}
+
+std::vector<const NodeScope *> NodePolicy::resolve(const std::vector<std::string> &scopes) const {
+    std::vector<const NodeScope *> r;
+    for (size_t i = 0; i < scopes.size(); i++) {
+        for (size_t j = 0; j < cfg.nodes.size(); j++) {
+            if (cfg.nodes[j].scope == scopes[i])
+                r.push_back(&cfg.nodes[j]);
+        }
+    }
+    return r;
+}
+
+// the node settings of a socket/iMC, least specific first
+static std::vector<std::string> scopes_of(const RefreshConfig &cfg, uint32_t socket, uint32_t imc) {
+    char sk[16], mc[32];
+    snprintf(sk, sizeof(sk), "S%u", socket);
+    snprintf(mc, sizeof(mc), "S%u.MC%u", socket, imc);
+    std::vector<std::string> r;
+    for (size_t i = 0; i < cfg.nodes.size(); i++) {
+        if (cfg.nodes[i].scope == sk)
+            r.insert(r.begin(), sk);
+        else if (cfg.nodes[i].scope == mc)
+            r.push_back(mc);
+    }
+    return r;
+}
+
+// the settings a channel of that node runs with, least specific first
+static std::vector<std::string> chain_of(const RefreshConfig &cfg, const NodeScope &node) {
+    unsigned sk = 0, mc = 0;
+    if (sscanf(node.scope.c_str(), "S%u.MC%u", &sk, &mc) == 2)
+        return scopes_of(cfg, sk, mc);
+    return std::vector<std::string>(1, node.scope);
+}
+
+bool NodePolicy::check(std::string *err) const {
+    std::unique_ptr<RefreshPolicy> p(make_scoped_policy(cfg, std::vector<const NodeScope *>(), err));
+    for (size_t i = 0; p && i < cfg.nodes.size(); i++)
+        p.reset(make_scoped_policy(cfg, resolve(chain_of(cfg, cfg.nodes[i])), err));
+    return p != NULL;
+}
+
+void NodePolicy::setTopology(const Topology &topo) {
+    groups.clear();
+    group_of.assign(topo.size(), 0);
+    local_of.assign(topo.size(), 0);
+    for (size_t ch = 0; ch < topo.size(); ch++) {
+        const std::vector<std::string> scopes = scopes_of(cfg, topo[ch].socket, topo[ch].imc);
+        size_t g = 0;
+        while (g < groups.size() && groups[g].scopes != scopes)
+            g++;
+        if (g == groups.size()) {
+            std::string err;
+            groups.push_back(Group());
+            groups[g].scopes = scopes;
+            groups[g].policy.reset(make_scoped_policy(cfg, resolve(scopes), &err)); // check() already built it once
+        }
+        group_of[ch] = g;
+        local_of[ch] = groups[g].channels.size();
+        groups[g].channels.push_back(ch);
+    }
+}
+
+void NodePolicy::init(int channels) {
+    if ((int)group_of.size() != channels) {
+        // no topology, every channel runs the global settings
+        Topology flat(channels, ChannelLocation());
+        std::vector<NodeScope> nodes;
+        nodes.swap(cfg.nodes);
+        setTopology(flat);
+        nodes.swap(cfg.nodes);
+    }
+    for (size_t g = 0; g < groups.size(); g++) {
+        Group &grp = groups[g];
+        const int n = grp.channels.size();
+        grp.policy->init(n);
+        grp.tick.resize(n);
+        grp.bw.assign(2 * n, 0);
+    }
+}
+
+Decision NodePolicy::decide(int channel, const ChannelSample &s) { return groups[group_of[channel]].policy->decide(local_of[channel], s); }
+
+void NodePolicy::decideTick(TickBatch *tick) {
+    for (size_t g = 0; g < groups.size(); g++) {
+        Group &grp = groups[g];
+        bool any = false;
+        for (size_t l = 0; l < grp.channels.size(); l++) {
+            const int ch = grp.channels[l];
+            grp.tick.due[l] = tick->due[ch];
+            if (tick->due[ch]) {
+                grp.tick.samples[l] = tick->samples[ch];
+                any = true;
+            }
+        }
+        if (!any)
+            continue;
+        grp.policy->decideTick(&grp.tick);
+        for (size_t l = 0; l < grp.channels.size(); l++) {
+            if (grp.tick.due[l])
+                tick->decisions[grp.channels[l]] = grp.tick.decisions[l];
+        }
+    }
+}
+
+bool NodePolicy::unstable(int channel) const { return groups[group_of[channel]].policy->unstable(local_of[channel]); }
+
+bool NodePolicy::wantsBandwidth() const {
+    for (size_t g = 0; g < groups.size(); g++) {
+        if (groups[g].policy->wantsBandwidth())
+            return true;
+    }
+    return false;
+}
+
+void NodePolicy::onBandwidth(const float *bw, std::vector<int> *reset) {
+    for (size_t g = 0; g < groups.size(); g++) {
+        Group &grp = groups[g];
+        if (!grp.policy->wantsBandwidth())
+            continue;
+        for (size_t l = 0; l < grp.channels.size(); l++) {
+            grp.bw[2 * l + 0] = bw[2 * grp.channels[l] + 0];
+            grp.bw[2 * l + 1] = bw[2 * grp.channels[l] + 1];
+        }
+        grp.reset.clear();
+        grp.policy->onBandwidth(&grp.bw[0], &grp.reset);
+        for (size_t r = 0; r < grp.reset.size(); r++)
+            reset->push_back(grp.channels[grp.reset[r]]);
+    }
+}
+
+const RankState *NodePolicy::ranks(int channel) const { return groups[group_of[channel]].policy->ranks(local_of[channel]); }
+
+int NodePolicy::weakestRank(int channel) const { return groups[group_of[channel]].policy->weakestRank(local_of[channel]); }
+
+void NodePolicy::printParams(std::ostream &out) const {
+    std::string err;
+    std::unique_ptr<RefreshPolicy> p(make_scoped_policy(cfg, std::vector<const NodeScope *>(), &err));
+    out << "  other channels: " << (p ? p->name() : "?") << ", target " << cfg.target << "\n";
+    if (p)
+        p->printParams(out);
+    for (size_t i = 0; i < cfg.nodes.size(); i++) {
+        const NodeScope &node = cfg.nodes[i];
+        const std::vector<const NodeScope *> chain = resolve(chain_of(cfg, node));
+        p.reset(make_scoped_policy(cfg, chain, &err));
+        std::string target = cfg.target;
+        for (size_t j = 0; j < chain.size(); j++) {
+            if (!chain[j]->target.empty())
+                target = chain[j]->target;
+        }
+        out << "  " << node.scope << ": " << (p ? p->name() : "?") << ", target " << target << "\n";
+        if (p)
+            p->printParams(out);
+    }
+}
+
+bool NodePolicy::retune(const RefreshPolicy &fresh) {
+    const NodePolicy *other = dynamic_cast<const NodePolicy *>(&fresh);
+    if (!other || other->cfg.nodes.size() != cfg.nodes.size())
+        return false;
+    for (size_t i = 0; i < cfg.nodes.size(); i++) {
+        if (other->cfg.nodes[i].scope != cfg.nodes[i].scope)
+            return false;
+    }
+
+    // the same groups, each keeps its history if its policy stays the same
+    std::vector<std::unique_ptr<RefreshPolicy>> tuned(groups.size());
+    for (size_t g = 0; g < groups.size(); g++) {
+        std::string err;
+        tuned[g].reset(make_scoped_policy(other->cfg, other->resolve(groups[g].scopes), &err));
+        if (!tuned[g] || strcmp(tuned[g]->name(), groups[g].policy->name()) != 0)
+            return false;
+    }
+    for (size_t g = 0; g < groups.size(); g++)
+        groups[g].policy->retune(*tuned[g]);
+    cfg = other->cfg;
+    label = other->label;
+    return true;
+}
@@ -0,0 +1,56 @@
+// Per NUMA node refresh policies
+//
+// On a multi-tenant host some nodes run latency critical services that want
+// every bit of bandwidth and others batch jobs where an error costs more than
+// the refresh. NodePolicy runs one policy instance per group of channels with
+// the same node settings (config.h: S<socket>.key, S<socket>.MC<imc>.key,
+// target presets) and forwards every call to the instance of the channel, so
+// each node gets its own aggressiveness while the controller still sees one
+// policy. The socket of a channel is its NUMA node in the discovered topology.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "policy.h"
+
+class NodePolicy : public RefreshPolicy {
+  public:
+    explicit NodePolicy(const RefreshConfig &cfg);
+
+    // every node setting builds into a valid policy
+    bool check(std::string *err) const;
+
+    const char *name() const { return label.c_str(); }
+    void setTopology(const Topology &topo);
+    void init(int channels);
+    Decision decide(int channel, const ChannelSample &s);
+    void decideTick(TickBatch *tick);
+    bool unstable(int channel) const;
+    bool wantsBandwidth() const;
+    void onBandwidth(const float *bw, std::vector<int> *reset);
+    const RankState *ranks(int channel) const;
+    int weakestRank(int channel) const;
+    void printParams(std::ostream &out) const;
+    bool retune(const RefreshPolicy &fresh);
+
+  private:
+    struct Group {
+        std::vector<std::string> scopes; // node settings that apply, least specific first
+        std::unique_ptr<RefreshPolicy> policy;
+        std::vector<int> channels; // global channel of every local one
+        TickBatch tick;
+        std::vector<float> bw;
+        std::vector<int> reset;
+    };
+
+    std::vector<const NodeScope *> resolve(const std::vector<std::string> &scopes) const;
+
+    RefreshConfig cfg;
+    std::string label;
+    std::vector<Group> groups;
+    std::vector<int> group_of, local_of; // per global channel
+};
@@ -0,0 +1,88 @@
+// Control loop latency and overhead instrumentation, see overhead.h
+
+#include <time.h>
+
+#include "overhead.h"
+
+HdrHistogram::HdrHistogram() { reset(); }
+
+void HdrHistogram::reset() {
+    for (int i = 0; i < HDR_BUCKETS; i++)
+        counts[i].store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    sum_ns.store(0, std::memory_order_relaxed);
+    max_ns.store(0, std::memory_order_relaxed);
+}
+
+// values below HDR_SUB_BUCKETS are exact, above that the top HDR_SUB_BITS + 1
+// bits pick the bucket
+int HdrHistogram::bucket(uint64_t ns) {
+    if (ns < HDR_SUB_BUCKETS)
+        return (int)ns;
+    const int shift = 63 - __builtin_clzll(ns) - HDR_SUB_BITS;
+    const int b = (shift + 1) * HDR_SUB_BUCKETS + (int)((ns >> shift) - HDR_SUB_BUCKETS);
+    return b < HDR_BUCKETS ? b : HDR_BUCKETS - 1;
+}
+
+uint64_t HdrHistogram::upper(int b) {
+    if (b < HDR_SUB_BUCKETS)
+        return b;
+    const int shift = b / HDR_SUB_BUCKETS - 1;
+    return ((uint64_t)(HDR_SUB_BUCKETS + b % HDR_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void HdrHistogram::record(uint64_t ns) {
+    counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    // single writer per histogram, a plain compare is enough
+    if (ns > max_ns.load(std::memory_order_relaxed))
+        max_ns.store(ns, std::memory_order_relaxed);
+}
+
+uint64_t HdrHistogram::quantile(double q) const {
+    const uint64_t n = count();
+    if (n == 0)
+        return 0;
+    const uint64_t rank = q <= 0 ? 1 : q >= 1 ? n : (uint64_t)(q * n + 0.5);
+    uint64_t seen = 0;
+    for (int b = 0; b < HDR_BUCKETS; b++) {
+        seen += counts[b].load(std::memory_order_relaxed);
+        if (seen >= rank && seen)
+            return upper(b) < max() ? upper(b) : max();
+    }
+    return max();
+}
+
+uint64_t overhead_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+OverheadStats::OverheadStats(const Topology &t) : topo(t), channels(new Channel[t.size()]), start_ns(overhead_now_ns()) {}
+
+static void dump_row(FILE *out, const char *name, const HdrHistogram &h) {
+    if (!h.count())
+        return;
+    fprintf(out, " %-22s %10llu %9.1f %9.1f %9.1f %9.1f %9.1f %10.1f\n", name, (unsigned long long)h.count(), h.sum() / 1e3 / h.count(),
+            h.quantile(0.5) / 1e3, h.quantile(0.9) / 1e3, h.quantile(0.99) / 1e3, h.quantile(0.999) / 1e3, h.max() / 1e3);
+}
+
+void OverheadStats::dump(FILE *out) const {
+    const double wall = (overhead_now_ns() - start_ns) / 1e9;
+    fprintf(out, " %-22s %10s %9s %9s %9s %9s %9s %10s\n", "overhead (us)", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    dump_row(out, "tick", tick);
+    dump_row(out, "wakeup lateness", wake);
+    dump_row(out, "register read batch", read);
+    dump_row(out, "bandwidth sample", bandwidth);
+    dump_row(out, "  uncore counters", uncore);
+    dump_row(out, "  calculate_bandwidth", calc_bw);
+    for (size_t i = 0; i < topo.size(); i++) {
+        const std::string name = channel_name(topo[i]);
+        dump_row(out, (name + " decision").c_str(), channels[i].decision);
+        dump_row(out, (name + " write").c_str(), channels[i].write);
+    }
+    if (wall > 0)
+        fprintf(out, " controller busy %.3f s of %.3f s wall time (%.4f%%)\n", tick.sum() / 1e9, wall, 100.0 * tick.sum() / 1e9 / wall);
+}
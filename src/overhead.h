@@ -0,0 +1,81 @@
+// Control loop latency and overhead instrumentation
+//
+// HdrHistogram is a log-linear histogram in the style of HdrHistogram:
+// every power of two of nanoseconds is split into HDR_SUB_BUCKETS linear
+// buckets, so any value from 1 ns to hours is kept with about 3% relative
+// error in a fixed array of relaxed atomic counters. Recording is lock free
+// and allocation free; a reader takes a snapshot while the loop runs.
+//
+// OverheadStats groups the histograms of one controller: per channel the
+// time from reading a sample to writing its tREFI and the cost of that
+// write, for the loop the register reads of a batch, the bandwidth sampling
+// (split into the uncore counter reads and calculate_bandwidth on PCM), the
+// wakeup lateness against the deadline and the work of every tick.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "topology.h"
+
+#define HDR_SUB_BITS 5
+#define HDR_SUB_BUCKETS (1 << HDR_SUB_BITS)
+#define HDR_OCTAVES 43 // up to 2^42 ns, over an hour
+#define HDR_BUCKETS (HDR_OCTAVES * HDR_SUB_BUCKETS)
+
+class HdrHistogram {
+  public:
+    HdrHistogram();
+
+    void record(uint64_t ns);
+    void reset();
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_ns.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_ns.load(std::memory_order_relaxed); }
+    // upper bound of the bucket holding quantile q (0..1), 0 when empty
+    uint64_t quantile(double q) const;
+
+  private:
+    static int bucket(uint64_t ns);
+    static uint64_t upper(int bucket);
+
+    std::atomic<uint64_t> counts[HDR_BUCKETS];
+    std::atomic<uint64_t> total, sum_ns, max_ns;
+};
+
+// elapsed ns on the monotonic clock, what every histogram records
+uint64_t overhead_now_ns();
+
+class OverheadStats {
+  public:
+    explicit OverheadStats(const Topology &topo);
+
+    HdrHistogram &decision(int channel) { return channels[channel].decision; }
+    HdrHistogram &write(int channel) { return channels[channel].write; }
+
+    HdrHistogram read;       // readChannels() of one batch
+    HdrHistogram bandwidth;  // readBandwidth() as the controller sees it
+    HdrHistogram uncore;     // getServerUncoreCounterState() of one socket (PCM)
+    HdrHistogram calc_bw;    // calculate_bandwidth() (PCM)
+    HdrHistogram wake;       // how late a wakeup was against its deadline
+    HdrHistogram tick;       // work of one tick, wakeup to going back to sleep
+
+    // table of every histogram and the busy fraction of the loop since
+    // construction
+    void dump(FILE *out) const;
+
+  private:
+    struct Channel {
+        HdrHistogram decision, write;
+    };
+
+    Topology topo;
+    std::unique_ptr<Channel[]> channels;
+    uint64_t start_ns;
+};
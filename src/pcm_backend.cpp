@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2009-2020, Intel Corporation
+
+// Based on Code by IntelPCM
+// PCM register backend split out of main_base_err_track_temp_slope.cpp
+
+#define PCM_USE_PCI_MM_LINUX
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "address.h"
+#include "pcm_backend.h"
+
+using namespace std;
+using namespace pcm;
+
+bool skipInactiveChannels = true;
+
+// read/write MB/s of the discovered channels only, straight into BW
+// BW[2 * i + 0] = read, BW[2 * i + 1] = write, -1 for an inactive channel
+static void calculate_bandwidth(const ServerUncoreCounterState uncState1[], const ServerUncoreCounterState uncState2[], const uint64 elapsedTime,
+                                const ServerUncoreMemoryMetrics &metrics, const Topology &topo, float *BW) {
+    auto toBW = [&elapsedTime](const uint64 nEvents) { return (float)(nEvents * 64 / 1000000.0 / (elapsedTime / 1000.0)); };
+
+    for (size_t i = 0; i < topo.size(); i++) {
+        const uint32 skt = topo[i].socket;
+        const uint32 channel = topo[i].pcm_channel;
+        const uint64 reads = getMCCounter(channel, ServerPCICFGUncore::EventPosition::READ, uncState1[skt], uncState2[skt]);
+        const uint64 writes = getMCCounter(channel, ServerPCICFGUncore::EventPosition::WRITE, uncState1[skt], uncState2[skt]);
+
+        if (skipInactiveChannels && (reads + writes == 0)) {
+            uint64 pmm = 0;
+            if (metrics == Pmem)
+                pmm = getMCCounter(channel, ServerPCICFGUncore::EventPosition::PMM_READ, uncState1[skt], uncState2[skt]) +
+                      getMCCounter(channel, ServerPCICFGUncore::EventPosition::PMM_WRITE, uncState1[skt], uncState2[skt]);
+            if (pmm == 0) {
+                BW[i * 2 + 0] = -1.0;
+                BW[i * 2 + 1] = -1.0;
+                continue;
+            }
+        }
+
+        // DRAM traffic is not counted in memory mode, the iMC only sees the near memory cache
+        BW[i * 2 + 0] = (metrics != PmemMemoryMode) ? toBW(reads) : 0;
+        BW[i * 2 + 1] = (metrics != PmemMemoryMode) ? toBW(writes) : 0;
+    }
+}
+
+static bool is_imc_function(uint32 group, uint32 bus, uint32 device, uint32 func) {
+    if (!PciHandleType::exists(group, bus, device, func))
+        return false;
+    PciHandleType h(group, bus, device, func);
+    uint32 id = 0;
+    h.read32(0, &id);
+    const uint32 vendor = id & 0xffff;
+    const uint32 did = (id >> 16) & 0xfff8;
+    return vendor == PCI_VENDOR_INTEL && (did == IMC0_HSX_DID || did == IMC1_HSX_DID || did == IMC0_BDX_DID || did == IMC1_BDX_DID);
+}
+
+// PCM only takes the sockets in bus order when it finds one iMC bus per
+// socket, otherwise it asks the uncore and the order may differ. Refuse to
+// run rather than read another socket's counters: the socket count and the
+// channels of every socket's controllers have to agree with PCM.
+static void check_socket_order(const Topology &t, uint32 sockets) {
+    PCM *m = PCM::getInstance();
+    if (m->getNumSockets() != sockets)
+        throw std::runtime_error("found " + std::to_string(sockets) + " iMC buses but PCM counts " + std::to_string(m->getNumSockets()) + " sockets");
+    for (uint32 s = 0; s < sockets; s++) {
+        for (uint32 imc = 0; imc < max_imc_per_socket; imc++) {
+            uint64 n = 0;
+            for (size_t i = 0; i < t.size(); i++)
+                n += t[i].socket == s && t[i].imc == imc;
+            if (n != m->getMCChannels(s, imc))
+                throw std::runtime_error("S" + std::to_string(s) + ".MC" + std::to_string(imc) + " has " + std::to_string(n) + " channels but PCM counts " +
+                                         std::to_string(m->getMCChannels(s, imc)));
+        }
+    }
+}
+
+Topology discover_topology() {
+    static const uint32 imc_device[max_imc_per_socket][2] = {{IMC0_CH01_Device, IMC0_CH23_Device}, {IMC1_CH01_Device, IMC1_CH23_Device}};
+    Topology t;
+
+    // every socket has its own uncore bus. PCM numbers the sockets of its
+    // uncore counter states by the iMC buses in ascending order, so this
+    // does too and the socket index picks the right getServerUncoreCounterState()
+    uint32 socket = 0;
+    for (uint32 bus = 0; bus <= 0xff; bus++) {
+        uint32 pcm_channel = 0; // PCM numbers the populated channels of a socket across its controllers
+        for (uint32 imc = 0; imc < max_imc_per_socket; imc++) {
+            for (uint32 ch = 0; ch < max_channel_per_imc; ch++) {
+                const uint32 device = imc_device[imc][ch / 2];
+                const uint32 func = ch % 2;
+                if (!is_imc_function(0, bus, device, func) || !is_imc_function(0, bus, device, func + 2))
+                    continue;
+                ChannelLocation loc = {socket, imc, ch, pcm_channel++, 0, bus, device, func, func + 2};
+                t.push_back(loc);
+            }
+        }
+        if (pcm_channel)
+            socket++;
+    }
+    if (!t.empty())
+        check_socket_order(t, socket);
+
+    if (t.empty()) {
+        static const uint32 group[num_channel] = {CH_A_Group, CH_B_Group, CH_C_Group, CH_D_Group};
+        static const uint32 bus[num_channel] = {CH_A_Bus, CH_B_Bus, CH_C_Bus, CH_D_Bus};
+        static const uint32 device[num_channel] = {CH_A_Device, CH_B_Device, CH_C_Device, CH_D_Device};
+        static const uint32 func[num_channel] = {CH_A_Func, CH_B_Func, CH_C_Func, CH_D_Func};
+        static const uint32 err_func[num_channel] = {CH_A_Err_Func, CH_B_Err_Func, CH_C_Err_Func, CH_D_Err_Func};
+
+        std::cerr << "No iMC channel found, falling back to the " << num_channel << " channels in address.h\n";
+        for (uint32 i = 0; i < num_channel; i++) {
+            ChannelLocation loc = {0, 0, i, i, group[i], bus[i], device[i], func[i], err_func[i]};
+            t.push_back(loc);
+        }
+    }
+    return t;
+}
+
+PcmRegisterBackend::PcmRegisterBackend(const Topology &t)
+    : RegisterBackend(t), m(NULL), BeforeState(NULL), AfterState(NULL), BeforeTime(0), overhead(NULL) {
+    // PciHandleType h(group, bus, device, function);
+    // one handle per function for the whole run, with PCM_USE_PCI_MM_LINUX
+    // PCM maps its config space through MMCONFIG once and every access after
+    // that is a plain load or store
+    for (size_t i = 0; i < topo.size(); i++) {
+        const ChannelLocation &loc = topo[i];
+        thermal.emplace_back(new PciHandleType(loc.group, loc.bus, loc.device, loc.func));
+        err.emplace_back(new PciHandleType(loc.group, loc.bus, loc.device, loc.err_func));
+    }
+}
+
+PcmRegisterBackend::~PcmRegisterBackend() {
+    delete[] BeforeState;
+    delete[] AfterState;
+}
+
+PciHandleType &PcmRegisterBackend::handle(int channel, ChannelRegister reg) {
+    if (reg == REG_ERR_CNT)
+        return *err[channel];
+    return *thermal[channel];
+}
+
+static uint64 reg_offset(ChannelRegister reg) {
+    switch (reg) {
+    case REG_TEMP:
+        return Temp_Off;
+    case REG_TREFI:
+        return tREFI_Off;
+    case REG_ERR_CNT:
+        return Err_cnt_Off;
+    }
+    return 0;
+}
+
+void PcmRegisterBackend::read32(int channel, ChannelRegister reg, uint32_t *value) {
+    uint32 v = 0;
+    handle(channel, reg).read32(reg_offset(reg), &v);
+    *value = v;
+}
+
+// unchanged values are already skipped by the controller (needs_write())
+void PcmRegisterBackend::write32(int channel, ChannelRegister reg, uint32_t value) { handle(channel, reg).write32(reg_offset(reg), value); }
+
+void PcmRegisterBackend::initCounters() {
+    m = PCM::getInstance();
+    metrics = m->PMMTrafficMetricsAvailable() ? Pmem : PartialWrites;
+
+    m->disableJKTWorkaround();
+    m->setBlocked(false);
+
+    // allocated once, only the sockets that own a channel are sampled
+    uint32 num_states = 0;
+    for (size_t i = 0; i < topo.size(); i++) {
+        if (find(sockets.begin(), sockets.end(), topo[i].socket) == sockets.end())
+            sockets.push_back(topo[i].socket);
+        num_states = max(num_states, topo[i].socket + 1);
+    }
+    BeforeState = new ServerUncoreCounterState[num_states];
+    AfterState = new ServerUncoreCounterState[num_states];
+
+    for (size_t i = 0; i < sockets.size(); ++i)
+        BeforeState[sockets[i]] = m->getServerUncoreCounterState(sockets[i]);
+    BeforeTime = m->getTickCount();
+}
+
+void PcmRegisterBackend::readBandwidth(float *bw) {
+    if (m == NULL)
+        initCounters();
+
+    uint64 AfterTime = m->getTickCount();
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        const uint64_t t0 = overhead ? overhead_now_ns() : 0;
+        AfterState[sockets[i]] = m->getServerUncoreCounterState(sockets[i]);
+        if (overhead)
+            overhead->uncore.record(overhead_now_ns() - t0);
+    }
+
+    const uint64_t t0 = overhead ? overhead_now_ns() : 0;
+    calculate_bandwidth(BeforeState, AfterState, AfterTime - BeforeTime, metrics, topo, bw);
+    if (overhead)
+        overhead->calc_bw.record(overhead_now_ns() - t0);
+    swap(BeforeTime, AfterTime);
+    swap(BeforeState, AfterState);
+}
+
+uint64_t PcmRegisterBackend::nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void PcmRegisterBackend::sleep(uint64_t us) { usleep(us); }
+
+// absolute CLOCK_MONOTONIC deadline, the same clock as nowUs(); a signal
+// ends the wait early like it does for usleep() so the loop sees its flags
+void PcmRegisterBackend::sleepUntil(uint64_t deadline_us) {
+    struct timespec ts;
+    ts.tv_sec = deadline_us / 1000000;
+    ts.tv_nsec = (deadline_us % 1000000) * 1000;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
@@ -0,0 +1,50 @@
+// PCM backed register access, iMC registers through PCM's MMCONFIG handles and
+// bandwidth through the PCM uncore counters
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "cpucounters.h"
+#include "overhead.h"
+#include "register_backend.h"
+
+// scan the uncore buses for every socket/iMC/channel, falls back to the
+// four channels hard-coded in address.h when no known iMC is found; throws
+// when the sockets found do not line up with PCM's
+
+Topology discover_topology();
+
+class PcmRegisterBackend : public RegisterBackend {
+  public:
+    explicit PcmRegisterBackend(const Topology &t);
+    ~PcmRegisterBackend();
+
+    const char *name() const { return "pcm"; }
+
+    void read32(int channel, ChannelRegister reg, uint32_t *value);
+    void write32(int channel, ChannelRegister reg, uint32_t value);
+    void readBandwidth(float *bw);
+    // time the uncore counter reads and calculate_bandwidth into o
+    void setOverhead(OverheadStats *o) { overhead = o; }
+    uint64_t nowUs();
+    void sleep(uint64_t us);
+    void sleepUntil(uint64_t deadline_us);
+
+  private:
+    pcm::PciHandleType &handle(int channel, ChannelRegister reg);
+    void initCounters();
+
+    std::vector<std::unique_ptr<pcm::PciHandleType>> thermal; // IMC Thermal Control
+    std::vector<std::unique_ptr<pcm::PciHandleType>> err;     // IMC Error Registers
+
+    // BW related state, set up on the first readBandwidth()
+    pcm::PCM *m;
+    pcm::ServerUncoreMemoryMetrics metrics;
+    pcm::ServerUncoreCounterState *BeforeState;
+    pcm::ServerUncoreCounterState *AfterState;
+    pcm::uint64 BeforeTime;
+    std::vector<pcm::uint32> sockets; // sockets with at least one channel
+    OverheadStats *overhead;
+};
@@ -0,0 +1,65 @@
+// Workload phase detector, see phase.h
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "address.h"
+#include "phase.h"
+
+PhaseParams::PhaseParams()
+    : alpha(0.05), drift(0.5), threshold(8), min_sd(0.1), read_abs(READ_ABS_MARGIN), write_abs(WRITE_ABS_MARGIN), warmup(20), holdoff(100) {}
+
+bool PhaseDetector::Cusum::update(const PhaseParams &p, double x) {
+    // a running average until warmup samples are in, then the EWMA
+    n++;
+    const double a = std::max(p.alpha, 1.0 / n);
+    const double sd = std::max(sqrt(var), p.min_sd);
+    const double z = n > 1 ? (x - mean) / sd : 0;
+    if (n > p.warmup) {
+        s = std::max(0.0, s + z - p.drift);
+        s_down = std::max(0.0, s_down - z - p.drift);
+    }
+    if (s_down > p.threshold) { // the level dropped, learn the new one
+        rebase();
+        return false;
+    }
+    if (s > p.threshold)
+        return true;
+
+    // clipped so an outlier or the start of a change barely moves the
+    // estimates, the mean stays put while a change may be building up
+    const double d = n > 1 ? std::min(std::max(z, -3.0), 3.0) * sd : x - mean;
+    if (s < p.threshold / 2 && s_down < p.threshold / 2)
+        mean += a * d;
+    if (n > 1)
+        var = (1 - a) * (var + a * d * d);
+    return false;
+}
+
+bool PhaseDetector::update(const PhaseParams &p, float read_mbps, float write_mbps) {
+    const double x[2] = {log1p(std::max(read_mbps, 0.0f)), log1p(std::max(write_mbps, 0.0f))};
+    const double floor[2] = {p.read_abs, p.write_abs};
+    const float bw[2] = {read_mbps, write_mbps};
+
+    bool change = false, heavy = false;
+    for (int d = 0; d < 2; d++) {
+        const bool up = dir[d].update(p, x[d]);
+        change |= up;
+        heavy |= up && bw[d] > floor[d];
+    }
+    if (quiet)
+        quiet--;
+    if (!change)
+        return false;
+
+    // either way the new level is the baseline of the next phase
+    for (int d = 0; d < 2; d++)
+        dir[d].rebase();
+    if (!heavy || quiet)
+        return false; // below the floor or in the holdoff
+    quiet = p.holdoff;
+    return true;
+}
+
+double PhaseDetector::score() const { return std::max(dir[0].s, dir[1].s); }
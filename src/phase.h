@@ -0,0 +1,55 @@
+// Workload phase detector
+//
+// Streaming change point detection on the read and write bandwidth of one
+// channel, in place of the BW_STUFF two phase averager. Each direction keeps
+// an EWMA of the mean and variance of log(1 + MB/s), so a phase is judged by
+// its ratio to the usual level like the old relative margins, and runs a one
+// sided (upward) CUSUM of the standardized samples:
+//   S = max(0, S + (x - mean) / sd - drift)
+// A heavy phase is flagged once S exceeds threshold and the sample is above
+// the absolute floor. The in-control average run length between false
+// alarms grows roughly like exp(2kh) in the drift k and threshold h,
+// Siegmund's approximation gives about 2e4 samples for the defaults, and
+// holdoff samples after every alarm bound the alarm rate further. The
+// baseline does not learn while S is rising, so a slow ramp is not absorbed.
+// After an alarm it is learned again from scratch over warmup samples, as
+// is the case when the mirrored downward CUSUM sees a heavy phase end.
+
+#pragma once
+
+#include <stdint.h>
+
+struct PhaseParams {
+    double alpha;     // EWMA weight of a new sample
+    double drift;     // CUSUM allowance k, in standard deviations
+    double threshold; // CUSUM decision level h, in standard deviations
+    double min_sd;    // floor of the log bandwidth deviation, a flat trace would alarm on noise otherwise
+    double read_abs, write_abs; // MB/s a heavy phase needs at least
+    double warmup;    // samples to learn a new baseline before it can alarm
+    double holdoff;   // samples after an alarm without another one
+
+    PhaseParams();
+};
+
+class PhaseDetector {
+  public:
+    PhaseDetector() : quiet(0) {}
+
+    // one bandwidth sample, true on the start of a heavy phase
+    bool update(const PhaseParams &p, float read_mbps, float write_mbps);
+
+    double score() const; // larger CUSUM of the two directions
+
+  private:
+    struct Cusum {
+        double mean, var, s, s_down;
+        uint64_t n; // samples since the last rebase
+
+        Cusum() : mean(0), var(0), s(0), s_down(0), n(0) {}
+        bool update(const PhaseParams &p, double x); // true when S crossed the threshold
+        void rebase() { s = s_down = 0, n = 0; } // keeps the variance, the noise level carries over
+    };
+
+    Cusum dir[2]; // read, write
+    uint64_t quiet; // samples left in the holdoff
+};
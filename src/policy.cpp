@@ -0,0 +1,616 @@
+// Refresh policies, see policy.h
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "address.h"
+#include "errtrack_kernel.h"
+#include "phase.h"
+#include "policy.h"
+#include "telemetry.h"
+#include "thermal.h"
+
+bool RefreshPolicy::setParam(const std::string &key, double value) {
+    for (size_t i = 0; i < params.size(); i++) {
+        if (key == params[i].key) {
+            *params[i].value = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+void RefreshPolicy::printParams(std::ostream &out) const {
+    for (size_t i = 0; i < params.size(); i++)
+        out << "  " << params[i].key << " = " << *params[i].value << "  (" << params[i].help << ")\n";
+}
+
+bool RefreshPolicy::retune(const RefreshPolicy &fresh) {
+    if (strcmp(name(), fresh.name()) != 0)
+        return false;
+    const std::vector<PolicyParam> &p = fresh.parameters();
+    for (size_t i = 0; i < p.size(); i++)
+        setParam(p[i].key, *p[i].value);
+    return true;
+}
+
+bool RefreshPolicy::validate(std::string *err) const {
+    for (size_t i = 0; i < params.size(); i++) {
+        const PolicyParam &p = params[i];
+        if (*p.value < p.min || *p.value > p.max) {
+            std::ostringstream msg;
+            msg << p.key << " = " << *p.value << " is outside " << p.min << " .. " << p.max;
+            *err = msg.str();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Error tracking: step tREFI up while error free, step down twice on a new
+// error (once when it shows up, once when the counter has settled). The
+// decision itself is errtrack_kernel.h, decideTick() runs it on every due
+// channel at once and decide() is its scalar reference.
+class ErrTrackPolicy : public RefreshPolicy {
+  public:
+    explicit ErrTrackPolicy(uint32_t base_trefi) : step_inc(step_tREFI_inc), step_dec(step_tREFI_dec << 1), min_trefi(0.5 * base_trefi), max_trefi(std::min(4.0 * base_trefi, (double)0x7fff)) {
+        params.push_back(PolicyParam{"step_inc", &step_inc, 1, 0x7fff, "tREFI increase per error free sample"});
+        params.push_back(PolicyParam{"step_dec", &step_dec, 0, 0x7fff, "tREFI decrease per error sample"});
+        params.push_back(PolicyParam{"min_trefi", &min_trefi, 1, 0x7fff, "lowest tREFI"});
+    }
+
+    const char *name() const { return "err-track"; }
+    void init(int channels) {
+        state.resize(channels);
+        lanes.resize(channels);
+    }
+    bool unstable(int channel) const { return state.err_det_r1[channel] || state.err_det_r0[channel]; }
+
+    Decision decide(int channel, const ChannelSample &s) {
+        int32_t limit, reason;
+        Decision d;
+        d.trefi = errtrack_decide(kernelParams(), &state, channel, s.temp, s.err_r0, s.err_r1, s.ovf_r0, s.ovf_r1, s.trefi, s.target, &limit, &reason);
+        d.limit = limit;
+        d.reason = reason;
+        return d;
+    }
+
+    void decideTick(TickBatch *tick) {
+        const size_t channels = tick->due.size();
+        for (size_t i = 0; i < channels; i++) {
+            const ChannelSample &s = tick->samples[i];
+            lanes.due[i] = tick->due[i];
+            lanes.temp[i] = s.temp;
+            lanes.err_r0[i] = s.err_r0;
+            lanes.err_r1[i] = s.err_r1;
+            lanes.ovf_r0[i] = s.ovf_r0;
+            lanes.ovf_r1[i] = s.ovf_r1;
+            lanes.trefi[i] = s.trefi;
+            lanes.target[i] = s.target;
+        }
+        errtrack_kernel(kernelParams(), &state, &lanes);
+        for (size_t i = 0; i < channels; i++) {
+            if (!tick->due[i])
+                continue;
+            Decision &d = tick->decisions[i];
+            d.trefi = lanes.out_trefi[i];
+            d.limit = lanes.out_limit[i];
+            d.reason = lanes.out_reason[i];
+        }
+    }
+
+  protected:
+    virtual CeilingQ8 ceilingQ8() const {
+        CeilingQ8 c = {0, (int32_t)max_trefi << 8, 0, 0};
+        return c;
+    }
+
+    ErrTrackParams kernelParams() const {
+        ErrTrackParams p = {(int32_t)step_inc, (int32_t)step_dec, (int32_t)min_trefi, ceilingQ8()};
+        return p;
+    }
+
+    double step_inc, step_dec, min_trefi, max_trefi;
+    ErrTrackState state;
+    ErrTrackLanes lanes;
+};
+
+class FixedLimitPolicy : public ErrTrackPolicy {
+  public:
+    explicit FixedLimitPolicy(uint32_t base_trefi) : ErrTrackPolicy(base_trefi) {
+        params.push_back(PolicyParam{"max_trefi", &max_trefi, 1, 0x7fff, "tREFI ceiling"});
+    }
+
+    bool validate(std::string *err) const {
+        if (!ErrTrackPolicy::validate(err))
+            return false;
+        if (max_trefi < min_trefi) {
+            *err = "max_trefi is below min_trefi";
+            return false;
+        }
+        return true;
+    }
+};
+
+// MAX tREFI 4.5xtREFI at 5'C, min tREFI 2tREFI at 85 'C
+// evaluated in fixed point (errtrack_kernel.h), the bounds are whole degC.
+// The line stays in clocks of the channel's base: above 1866 MT/s 4.5x base
+// does not fit the 15 bit field and the limit saturates at 0x7fff on the
+// cool end, the 2x base at 85 degC is unchanged.
+struct TempCeiling {
+    double slope, offset, temp_min, temp_max;
+
+    explicit TempCeiling(uint32_t base_trefi) : slope(base_trefi * 2.5 / 80), offset(base_trefi * (4.5 + 2.5 / 80 * 5)), temp_min(5), temp_max(85) {}
+
+    void addParams(std::vector<PolicyParam> *params) {
+        params->push_back(PolicyParam{"temp_slope", &slope, 0, 0x7fff, "tREFI ceiling drop per degC"});
+        params->push_back(PolicyParam{"temp_offset", &offset, 0, 0xffff, "tREFI ceiling at 0 degC"});
+        params->push_back(PolicyParam{"temp_min", &temp_min, 0, 255, "temperature the ceiling stops rising at"});
+        params->push_back(PolicyParam{"temp_max", &temp_max, 0, 255, "temperature the ceiling stops falling at"});
+    }
+
+    bool validate(double min_trefi, std::string *err) const {
+        if (temp_min > temp_max) {
+            *err = "temp_min is above temp_max";
+            return false;
+        }
+        // the limit saturates at the 15 bit field, but the hot end has to stay above min_trefi
+        if (offset - slope * temp_max < min_trefi) {
+            *err = "temp_offset and temp_slope put the tREFI ceiling below min_trefi";
+            return false;
+        }
+        return true;
+    }
+
+    CeilingQ8 fixed() const {
+        CeilingQ8 c = {(int32_t)lround(slope * 256), (int32_t)lround(offset * 256), (int32_t)temp_min, (int32_t)temp_max};
+        return c;
+    }
+
+    uint32_t limit(uint32_t t) const { return ceiling_limit(fixed(), t); }
+};
+
+class TempSlopePolicy : public ErrTrackPolicy {
+  public:
+    explicit TempSlopePolicy(uint32_t base_trefi) : ErrTrackPolicy(base_trefi), ceiling(base_trefi) { ceiling.addParams(&params); }
+
+    const char *name() const { return "temp-slope"; }
+
+    bool validate(std::string *err) const { return ErrTrackPolicy::validate(err) && ceiling.validate(min_trefi, err); }
+
+  protected:
+    CeilingQ8 ceilingQ8() const { return ceiling.fixed(); }
+
+    TempCeiling ceiling;
+};
+
+// temp-slope with the ceiling taken at the temperature a per-channel thermal
+// model (thermal.h) expects horizon_s ahead, so a load burst lowers the
+// ceiling while the DIMM is still heating up instead of after. A cooling
+// forecast keeps the current reading, the ceiling never runs ahead of it.
+class TempPredictPolicy : public TempSlopePolicy {
+  public:
+    explicit TempPredictPolicy(uint32_t base_trefi) : TempSlopePolicy(base_trefi) {
+        params.push_back(PolicyParam{"horizon_s", &thermal.horizon_s, 0, 600, "seconds ahead the temperature is forecast"});
+        params.push_back(PolicyParam{"fit_dt_s", &thermal.fit_dt_s, 0.01, 60, "shortest span a temperature slope is fitted over"});
+        params.push_back(PolicyParam{"forgetting", &thermal.forgetting, 0.5, 1, "thermal model forgetting factor per fitted slope"});
+        params.push_back(PolicyParam{"model_warmup", &thermal.warmup, 0, 1e6, "fitted slopes before the forecast is used"});
+    }
+
+    const char *name() const { return "temp-predict"; }
+    bool wantsBandwidth() const { return true; }
+
+    void init(int channels) {
+        TempSlopePolicy::init(channels);
+        models.assign(channels, ThermalModel());
+    }
+
+    void onBandwidth(const float *bw, std::vector<int> * /*reset*/) {
+        for (size_t i = 0; i < models.size(); i++) {
+            if (bw[2 * i + 0] >= 0) // -1 for an inactive channel
+                models[i].bandwidth(bw[2 * i + 0] + bw[2 * i + 1]);
+        }
+    }
+
+    Decision decide(int channel, const ChannelSample &s) {
+        ChannelSample ahead = s;
+        ahead.temp = expected(channel, s);
+        return TempSlopePolicy::decide(channel, ahead);
+    }
+
+    void decideTick(TickBatch *tick) {
+        temps.resize(tick->due.size());
+        for (size_t i = 0; i < tick->due.size(); i++) {
+            if (!tick->due[i])
+                continue;
+            temps[i] = tick->samples[i].temp;
+            tick->samples[i].temp = expected(i, tick->samples[i]);
+        }
+        TempSlopePolicy::decideTick(tick);
+        for (size_t i = 0; i < tick->due.size(); i++) {
+            if (tick->due[i])
+                tick->samples[i].temp = temps[i];
+        }
+    }
+
+  private:
+    uint32_t expected(int channel, const ChannelSample &s) {
+        const double forecast = models[channel].update(thermal, s.time_us, s.temp);
+        return std::max<uint32_t>(s.temp, (uint32_t)std::max(ceil(forecast), 0.0));
+    }
+
+    std::vector<uint32_t> temps; // readings while decideTick works on the forecast
+    ThermalParams thermal;
+    std::vector<ThermalModel> models;
+};
+
+// temp-slope plus the BW_STUFF two phase bandwidth averager, kept for
+// comparison with bw-reset
+class BwAveragePolicy : public TempSlopePolicy {
+  public:
+    explicit BwAveragePolicy(uint32_t base_trefi)
+        : TempSlopePolicy(base_trefi), loop_count(average_loop_count), read_abs(READ_ABS_MARGIN), write_abs(WRITE_ABS_MARGIN), read_rel(READ_REL_MARGIN), write_rel(WRITE_REL_MARGIN),
+          count(0), phase(0), steady_state(false) {
+        params.push_back(PolicyParam{"average_loop_count", &loop_count, 1, 1000, "bandwidth samples per averaging phase"});
+        params.push_back(PolicyParam{"read_abs_margin", &read_abs, 0, 1e6, "MB/s a heavy read phase needs at least"});
+        params.push_back(PolicyParam{"write_abs_margin", &write_abs, 0, 1e6, "MB/s a heavy write phase needs at least"});
+        params.push_back(PolicyParam{"read_rel_margin", &read_rel, 0, 1000, "read bandwidth over the last average for a heavy phase"});
+        params.push_back(PolicyParam{"write_rel_margin", &write_rel, 0, 1000, "write bandwidth over the last average for a heavy phase"});
+    }
+
+    const char *name() const { return "bw-average"; }
+    bool wantsBandwidth() const { return true; }
+
+    void init(int channels) {
+        TempSlopePolicy::init(channels);
+        BW_average.assign(2 * channels * 2, 0);
+        donot_reset_signal.assign(channels, 0);
+        do_not_reset_count.assign(channels, 0);
+        count = 0;
+        phase = 0;
+        steady_state = false;
+    }
+
+    void onBandwidth(const float *BW, std::vector<int> *reset) {
+        const int channels = donot_reset_signal.size();
+        const int average_count = loop_count;
+
+        // bw read
+        count++;
+        // count the number of loops passed since being reset
+        for (int i = 0; i < channels; i++) {
+            if (donot_reset_signal[i]) {
+                do_not_reset_count[i]++;
+            }
+        }
+
+        // bw average -> steady state after 10 cycles
+        if (count == average_count) {
+            steady_state = true;
+            count = 0;
+
+            // compute average bw
+            for (int i = 0; i < (channels * 2); i++) {
+                BW_average[phase * (channels * 2) + i] /= average_count;
+            }
+
+            // change phase
+            phase = !phase;
+
+            // reset average value for phase
+            for (int i = 0; i < (channels * 2); i++) {
+                BW_average[phase * (channels * 2) + i] = 0;
+            }
+        }
+
+        // store cumulative bw vals
+        for (int i = 0; i < channels; i++) {
+            for (int j = 0; j < 2; j++) {
+                BW_average[phase * (channels * 2) + i * 2 + j] += BW[i * 2 + j];
+            }
+        }
+
+        // after average_loop_count * average_loop_count loops enable reset again
+        for (int i = 0; i < channels; i++) {
+            if (donot_reset_signal[i] && (do_not_reset_count[i] > average_count * average_count)) {
+                donot_reset_signal[i] = 0;
+            }
+        }
+
+        // decide if a workload is heavy
+        if (!steady_state)
+            return;
+        for (int i = 0; i < channels; i++) {
+            if (donot_reset_signal[i]) // if  reset in the last average_loop_count * average_loop_count do not reset any more
+                continue;
+            int read_write[2] = {0};
+            // read threshold
+            if (((BW_average[(!phase) * (channels * 2) + i * 2 + 0] * read_rel) < BW[i * 2 + 0]) && (read_abs < BW[i * 2 + 0])) {
+                read_write[0] = 1;
+            }
+            // write threshold
+            if (((BW_average[(!phase) * (channels * 2) + i * 2 + 1] * write_rel) < BW[i * 2 + 1]) && (write_abs < BW[i * 2 + 1])) {
+                read_write[1] = 1;
+            }
+            if (read_write[0] + read_write[1] > 0) {
+                reset->push_back(i);
+                donot_reset_signal[i] = 1;
+                do_not_reset_count[i] = 0;
+            }
+        }
+    }
+
+  private:
+    double loop_count, read_abs, write_abs, read_rel, write_rel;
+
+    std::vector<float> BW_average; // phase - channel - read/write
+    int count;
+    int phase;
+    bool steady_state;
+    std::vector<int> donot_reset_signal;
+    std::vector<int> do_not_reset_count;
+};
+
+// temp-slope plus halving tREFI at the start of a heavy bandwidth phase,
+// found by a per-channel CUSUM change point detector (phase.h)
+class BwResetPolicy : public TempSlopePolicy {
+  public:
+    explicit BwResetPolicy(uint32_t base_trefi) : TempSlopePolicy(base_trefi) {
+        params.push_back(PolicyParam{"phase_alpha", &phase.alpha, 0.001, 1, "EWMA weight of the bandwidth baseline"});
+        params.push_back(PolicyParam{"phase_drift", &phase.drift, 0, 10, "CUSUM allowance in standard deviations"});
+        params.push_back(PolicyParam{"phase_threshold", &phase.threshold, 0.1, 1000, "CUSUM alarm level in standard deviations"});
+        params.push_back(PolicyParam{"phase_min_sd", &phase.min_sd, 0.001, 10, "floor of the log bandwidth standard deviation"});
+        params.push_back(PolicyParam{"read_abs_margin", &phase.read_abs, 0, 1e6, "MB/s a heavy read phase needs at least"});
+        params.push_back(PolicyParam{"write_abs_margin", &phase.write_abs, 0, 1e6, "MB/s a heavy write phase needs at least"});
+        params.push_back(PolicyParam{"phase_warmup", &phase.warmup, 0, 1e6, "bandwidth samples before the first alarm"});
+        params.push_back(PolicyParam{"phase_holdoff", &phase.holdoff, 0, 1e6, "bandwidth samples after an alarm without another one"});
+    }
+
+    const char *name() const { return "bw-reset"; }
+    bool wantsBandwidth() const { return true; }
+
+    void init(int channels) {
+        TempSlopePolicy::init(channels);
+        detectors.assign(channels, PhaseDetector());
+    }
+
+    void onBandwidth(const float *bw, std::vector<int> *reset) {
+        for (size_t i = 0; i < detectors.size(); i++) {
+            if (bw[2 * i + 0] >= 0 && detectors[i].update(phase, bw[2 * i + 0], bw[2 * i + 1])) // -1 for an inactive channel
+                reset->push_back(i);
+        }
+    }
+
+  private:
+    PhaseParams phase;
+    std::vector<PhaseDetector> detectors;
+};
+
+// PID on the measured error rate against an error budget
+//
+// The error rate is an exponentially weighted average of the counter deltas
+// over rate_tau_s. The error e = err_budget - rate is positive while the
+// channel has budget left, so the integral keeps raising tREFI until the
+// errors it causes use up the budget.
+//
+// The loop runs on tREFI normalized to ref_temp. Retention roughly halves
+// every halving_degc, so the output is scaled by 2^((ref_temp - temp) /
+// halving_degc) as feed forward and the integral only has to learn the
+// retention of the DIMM, not follow every temperature swing. The scaled
+// output is clamped to min_trefi .. temp-slope ceiling, and the integral is
+// clamped with it so it does not wind up while a bound holds (anti-windup).
+class PidPolicy : public RefreshPolicy {
+  public:
+    explicit PidPolicy(uint32_t base_trefi)
+        : ceiling(base_trefi), base(base_trefi), min_trefi(0.5 * base_trefi), budget(0.2), tau(30), kp(1000), ki(1000), kd(0), ref_temp(45),
+          halving(10) {
+        params.push_back(PolicyParam{"err_budget", &budget, 0, 1e6, "errors per second the controller aims for"});
+        params.push_back(PolicyParam{"rate_tau_s", &tau, 0.1, 3600, "time constant of the error rate average in s"});
+        params.push_back(PolicyParam{"kp", &kp, 0, 1e9, "tREFI per error/s of rate error"});
+        params.push_back(PolicyParam{"ki", &ki, 0, 1e9, "tREFI per error/s of rate error and second"});
+        params.push_back(PolicyParam{"kd", &kd, 0, 1e9, "tREFI per error/s^2 of rate error change"});
+        params.push_back(PolicyParam{"min_trefi", &min_trefi, 1, 0x7fff, "lowest tREFI"});
+        params.push_back(PolicyParam{"ref_temp", &ref_temp, 0, 255, "temperature the loop state is normalized to"});
+        params.push_back(PolicyParam{"halving_degc", &halving, 1, 1000, "temperature rise that halves retention, 1000 for no feed forward"});
+        ceiling.addParams(&params);
+    }
+
+    const char *name() const { return "pid"; }
+    void init(int channels) { ch.assign(channels, PidState()); }
+    bool unstable(int channel) const { return ch[channel].rate > budget; }
+    bool validate(std::string *err) const { return RefreshPolicy::validate(err) && ceiling.validate(min_trefi, err); }
+
+    Decision decide(int channel, const ChannelSample &s) {
+        PidState &p = ch[channel];
+        Decision d;
+        d.limit = ceiling.limit(s.temp);
+
+        // new errors since the last sample, a cleared counter restarts at 0
+        uint32_t errors = (s.err_r0 >= p.pre_err_r0_val ? s.err_r0 - p.pre_err_r0_val : s.err_r0) +
+                          (s.err_r1 >= p.pre_err_r1_val ? s.err_r1 - p.pre_err_r1_val : s.err_r1);
+        if ((s.ovf_r0 || s.ovf_r1) && errors == 0)
+            errors = 1;
+        p.pre_err_r0_val = s.err_r0;
+        p.pre_err_r1_val = s.err_r1;
+
+        const double dt = p.samples ? (s.time_us - p.last_us) / 1e6 : 0;
+        p.last_us = s.time_us;
+        p.rate = p.rate * exp(-dt / tau) + errors / tau;
+
+        const double e = budget - p.rate;
+        const double de = dt > 0 ? (e - p.last_e) / dt : 0;
+        p.last_e = e;
+        p.integral += ki * e * dt;
+
+        // anti-windup: keep the integral inside what the output can reach
+        const double scale = pow(2.0, (ref_temp - (double)s.temp) / halving);
+        const double lo = min_trefi / scale, hi = std::max<double>(d.limit, min_trefi) / scale;
+        const double pd = kp * e + kd * de;
+        // a warm start above base (retention profile) continues from there
+        if (p.samples == 0)
+            p.integral = std::max(0.0, s.trefi / scale - base - pd);
+        p.integral = std::min(std::max(p.integral, lo - base - pd), hi - base - pd);
+        const double u = std::min(std::max(base + pd + p.integral, lo), hi) * scale;
+        p.samples++;
+
+        d.trefi = u;
+        if (errors)
+            d.reason = REASON_ERR;
+        else if (d.trefi >= d.limit)
+            d.reason = REASON_AT_LIMIT;
+        else if (d.trefi >= s.trefi)
+            d.reason = REASON_INC;
+        else
+            d.reason = REASON_ERR_CLEAR; // still paying off the budget
+        return d;
+    }
+
+  private:
+    struct PidState {
+        uint32_t pre_err_r1_val, pre_err_r0_val;
+        uint64_t last_us, samples;
+        double rate; // errors per second
+        double integral, last_e;
+
+        PidState() : pre_err_r1_val(0), pre_err_r0_val(0), last_us(0), samples(0), rate(0), integral(0), last_e(0) {}
+    };
+
+    TempCeiling ceiling;
+    double base, min_trefi, budget, tau, kp, ki, kd, ref_temp, halving;
+    std::vector<PidState> ch;
+};
+
+// Per-rank error tracking
+//
+// Every error tells at which tREFI its rank failed. Each rank keeps the
+// lowest such tREFI, normalized to ref_temp like the pid policy, as its
+// failure point. The channel runs margin below the failure point of its
+// weakest rank instead of stepping down on every error of any rank, so the
+// stronger rank never sets the pace. After probe_s without an error the
+// weakest failure point is pushed up by step_inc per sample until the rank
+// fails again, which follows retention that improved since.
+class WeakestRankPolicy : public RefreshPolicy {
+  public:
+    explicit WeakestRankPolicy(uint32_t base_trefi)
+        : ceiling(base_trefi), step_inc(step_tREFI_inc), min_trefi(0.5 * base_trefi), margin(0.03), probe_s(60), tau(30), ref_temp(45), halving(10) {
+        params.push_back(PolicyParam{"step_inc", &step_inc, 1, 0x7fff, "tREFI increase per sample while climbing or probing"});
+        params.push_back(PolicyParam{"min_trefi", &min_trefi, 1, 0x7fff, "lowest tREFI"});
+        params.push_back(PolicyParam{"margin", &margin, 0, 0.9, "fraction below the weakest rank's failure point"});
+        params.push_back(PolicyParam{"probe_s", &probe_s, 0, 86400, "error free seconds before probing above the failure point"});
+        params.push_back(PolicyParam{"rate_tau_s", &tau, 0.1, 3600, "time constant of the per-rank error rate in s"});
+        params.push_back(PolicyParam{"ref_temp", &ref_temp, 0, 255, "temperature failure points are normalized to"});
+        params.push_back(PolicyParam{"halving_degc", &halving, 1, 1000, "temperature rise that halves retention"});
+        ceiling.addParams(&params);
+    }
+
+    const char *name() const { return "weakest-rank"; }
+    void init(int channels) { ch.assign(channels, ChannelRanks()); }
+    bool validate(std::string *err) const { return RefreshPolicy::validate(err) && ceiling.validate(min_trefi, err); }
+    bool unstable(int channel) const { return ch[channel].last_err_us && ch[channel].last_us - ch[channel].last_err_us < 1000000; }
+    const RankState *ranks(int channel) const { return ch[channel].rank; }
+    int weakestRank(int channel) const { return weakest(ch[channel]); }
+
+    Decision decide(int channel, const ChannelSample &s) {
+        ChannelRanks &c = ch[channel];
+        Decision d;
+        d.limit = ceiling.limit(s.temp);
+
+        const double dt = c.samples ? (s.time_us - c.last_us) / 1e6 : 0;
+        const double scale = pow(2.0, (ref_temp - (double)s.temp) / halving);
+        const uint32_t cnt[2] = {s.err_r0, s.err_r1};
+        const bool ovf[2] = {s.ovf_r0, s.ovf_r1};
+        bool errors = false;
+        for (int r = 0; r < 2; r++) {
+            RankState &k = c.rank[r];
+            // new errors since the last sample, a cleared counter restarts at 0
+            uint32_t n = cnt[r] >= c.pre_err[r] ? cnt[r] - c.pre_err[r] : cnt[r];
+            if (ovf[r] && n == 0)
+                n = 1;
+            c.pre_err[r] = cnt[r];
+            k.rate = k.rate * exp(-dt / tau) + n / tau;
+            if (!n)
+                continue;
+            errors = true;
+            k.errors += n;
+            k.last_err_us = s.time_us;
+            // the errors built up at the tREFI in the register since the last sample
+            const double fail = s.trefi / scale;
+            k.fail_trefi = k.fail_trefi > 0 ? std::min(k.fail_trefi, fail) : fail;
+        }
+        if (errors)
+            c.last_err_us = s.time_us;
+        c.last_us = s.time_us;
+        c.samples++;
+
+        const int w = weakest(c);
+        double trefi = s.target;
+        if (w < 0) {
+            trefi += step_inc; // nothing failed yet, climb like err-track
+        } else {
+            RankState &k = c.rank[w];
+            if (!errors && (s.time_us - c.last_err_us) / 1e6 >= probe_s)
+                k.fail_trefi += step_inc / scale;
+            const double target = k.fail_trefi * (1 - margin) * scale;
+            trefi = errors || trefi > target ? target : std::min(trefi + step_inc, target);
+        }
+        trefi = std::min(std::max(trefi, min_trefi), std::max<double>(d.limit, min_trefi));
+
+        d.trefi = trefi;
+        if (errors)
+            d.reason = REASON_ERR;
+        else if (d.trefi >= d.limit)
+            d.reason = REASON_AT_LIMIT;
+        else if (d.trefi >= s.trefi)
+            d.reason = REASON_INC;
+        else
+            d.reason = REASON_ERR_CLEAR;
+        return d;
+    }
+
+  private:
+    struct ChannelRanks {
+        RankState rank[2];
+        uint32_t pre_err[2];
+        uint64_t last_us, last_err_us, samples;
+
+        ChannelRanks() : last_us(0), last_err_us(0), samples(0) { pre_err[0] = pre_err[1] = 0; }
+    };
+
+    // rank with the lowest known failure point, -1 while no rank failed
+    static int weakest(const ChannelRanks &c) {
+        int w = -1;
+        for (int r = 0; r < 2; r++) {
+            if (c.rank[r].fail_trefi > 0 && (w < 0 || c.rank[r].fail_trefi < c.rank[w].fail_trefi))
+                w = r;
+        }
+        return w;
+    }
+
+    TempCeiling ceiling;
+    double step_inc, min_trefi, margin, probe_s, tau, ref_temp, halving;
+    std::vector<ChannelRanks> ch;
+};
+
+RefreshPolicy *make_policy(const std::string &name, uint32_t base_trefi) {
+    if (name == "err-track")
+        return new FixedLimitPolicy(base_trefi);
+    if (name == "temp-slope")
+        return new TempSlopePolicy(base_trefi);
+    if (name == "temp-predict")
+        return new TempPredictPolicy(base_trefi);
+    if (name == "bw-reset")
+        return new BwResetPolicy(base_trefi);
+    if (name == "bw-average")
+        return new BwAveragePolicy(base_trefi);
+    if (name == "pid")
+        return new PidPolicy(base_trefi);
+    if (name == "weakest-rank")
+        return new WeakestRankPolicy(base_trefi);
+    return NULL;
+}
+
+const char *policy_names() { return "err-track, temp-slope, temp-predict, bw-reset, bw-average, pid, weakest-rank"; }
+
@@ -0,0 +1,123 @@
+// Refresh policies
+//
+// A policy turns the registers of one channel sample into a tREFI decision.
+// The controller owns the register I/O, scheduling and telemetry; policies
+// keep whatever per-channel history they need. The built-ins are the
+// heuristics of the old separate executables:
+//   err-track   error tracking with a fixed tREFI ceiling (main_base_err_track_no_temp.cpp)
+//   temp-slope  error tracking with a temperature dependent ceiling (main_base_err_track_temp_slope.cpp)
+//   bw-average  temp-slope plus halving tREFI on a heavy bandwidth phase (BW_STUFF)
+// and the alternatives:
+//   bw-reset    bw-average with a CUSUM phase detector (phase.h) instead of the averager
+//   temp-predict temp-slope with the ceiling from a thermal model forecast (thermal.h)
+//   pid         PID on the error rate against an error budget, capped by the temp-slope ceiling
+//   weakest-rank tREFI just below the learned failure point of the weakest rank
+
+#pragma once
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "topology.h"
+
+struct ChannelSample {
+    uint64_t time_us;
+    uint32_t temp;
+    uint32_t err_r0, err_r1; // error counters
+    bool ovf_r0, ovf_r1;     // overflow bits
+    uint32_t trefi;          // tREFI currently in the register, what the errors ran at
+    uint32_t target;         // tREFI to climb from: the policy's last choice while a write
+                             // band holds it back from the register, else trefi
+};
+
+struct Decision {
+    uint32_t trefi;
+    uint32_t limit;
+    uint8_t reason; // DecisionReason
+};
+
+// one controller tick, indexed by channel; samples and decisions are only
+// valid where due is set
+struct TickBatch {
+    std::vector<uint8_t> due;
+    std::vector<ChannelSample> samples;
+    std::vector<Decision> decisions;
+
+    void resize(int channels) {
+        due.assign(channels, 0);
+        samples.resize(channels);
+        decisions.resize(channels);
+    }
+};
+
+// what a policy learned about one rank of a channel
+struct RankState {
+    uint64_t errors;   // errors counted so far
+    double rate;       // errors per second, exponentially averaged
+    double fail_trefi; // tREFI at the reference temperature where the rank fails, 0 while unknown
+    uint64_t last_err_us;
+
+    RankState() : errors(0), rate(0), fail_trefi(0), last_err_us(0) {}
+};
+
+// named numeric tuning knob of a policy, valid in [min, max]
+struct PolicyParam {
+    const char *key;
+    double *value;
+    double min, max;
+    const char *help;
+};
+
+class RefreshPolicy {
+  public:
+    virtual ~RefreshPolicy() {}
+
+    virtual const char *name() const = 0;
+    // called before init() with the channels in topology order
+    virtual void setTopology(const Topology & /*topo*/) {}
+    virtual void init(int channels) = 0;
+    virtual Decision decide(int channel, const ChannelSample &s) = 0;
+
+    // every channel due in a tick, calls decide() for each unless a policy
+    // has a kernel for the whole batch
+    virtual void decideTick(TickBatch *tick) {
+        for (size_t i = 0; i < tick->due.size(); i++) {
+            if (tick->due[i])
+                tick->decisions[i] = decide(i, tick->samples[i]);
+        }
+    }
+
+    // true while the channel recovers from an error, sampled more often
+    virtual bool unstable(int /*channel*/) const { return false; }
+
+    // bandwidth sampling, bw[2 * ch + 0/1] = read/write MB/s
+    // channels to halve right away are appended to reset
+    virtual bool wantsBandwidth() const { return false; }
+    virtual void onBandwidth(const float * /*bw*/, std::vector<int> * /*reset*/) {}
+
+    // rank0/rank1 state of a channel for policies that track ranks, else NULL
+    virtual const RankState *ranks(int /*channel*/) const { return NULL; }
+    virtual int weakestRank(int /*channel*/) const { return -1; }
+
+    bool setParam(const std::string &key, double value);
+    virtual void printParams(std::ostream &out) const;
+
+    // take over the parameters of a freshly configured policy and keep the
+    // per-channel history, false when fresh is of another kind and has to
+    // replace this one
+    virtual bool retune(const RefreshPolicy &fresh);
+    const std::vector<PolicyParam> &parameters() const { return params; }
+
+    // range check of every parameter, policies add their cross checks
+    virtual bool validate(std::string *err) const;
+
+  protected:
+    std::vector<PolicyParam> params;
+};
+
+// NULL for an unknown name, parameter defaults scale with base_trefi
+RefreshPolicy *make_policy(const std::string &name, uint32_t base_trefi);
+const char *policy_names();
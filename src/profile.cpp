@@ -0,0 +1,144 @@
+// Retention profile, see profile.h
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "profile.h"
+#include "register_backend.h"
+
+#define PROFILE_VERSION 1
+
+const ChannelProfile *RetentionProfile::find(const ChannelLocation &loc) const {
+    for (size_t i = 0; i < chan.size(); i++) {
+        if (chan[i].socket == loc.socket && chan[i].imc == loc.imc && chan[i].channel == loc.channel)
+            return &chan[i];
+    }
+    return NULL;
+}
+
+void RetentionProfile::record(const ChannelLocation &loc, uint32_t temp, uint32_t fail_trefi) {
+    ChannelProfile *c = const_cast<ChannelProfile *>(find(loc));
+    if (c == NULL) {
+        ChannelProfile p;
+        p.socket = loc.socket;
+        p.imc = loc.imc;
+        p.channel = loc.channel;
+        size_t at = 0; // topology order
+        while (at < chan.size() && (chan[at].socket < p.socket || (chan[at].socket == p.socket && (chan[at].imc < p.imc ||
+                                                                                                      (chan[at].imc == p.imc && chan[at].channel < p.channel)))))
+            at++;
+        c = &*chan.insert(chan.begin() + at, p);
+    }
+
+    const uint32_t lo = temp / bucket_degc * bucket_degc;
+    size_t i = 0;
+    while (i < c->buckets.size() && c->buckets[i].temp_lo < lo)
+        i++;
+    if (i == c->buckets.size() || c->buckets[i].temp_lo != lo) {
+        ProfileBucket b = {lo, fail_trefi, 0};
+        c->buckets.insert(c->buckets.begin() + i, b);
+    }
+    c->buckets[i].fail_trefi = std::min(c->buckets[i].fail_trefi, fail_trefi);
+    c->buckets[i].hits++;
+}
+
+uint32_t RetentionProfile::safeTrefi(const ChannelLocation &loc, uint32_t temp, double margin) const {
+    const ChannelProfile *c = find(loc);
+    if (c == NULL || c->buckets.empty())
+        return 0;
+
+    // nearest bucket, the hotter one on a tie since it is the more conservative
+    const ProfileBucket *best = NULL;
+    double best_dist = 0;
+    for (size_t i = 0; i < c->buckets.size(); i++) {
+        const double mid = c->buckets[i].temp_lo + bucket_degc / 2.0;
+        const double dist = fabs(mid - temp);
+        if (best == NULL || dist <= best_dist) {
+            best = &c->buckets[i];
+            best_dist = dist;
+        }
+    }
+    // only ever scaled down: colder than anything measured keeps the measured point
+    const bool inside = temp >= best->temp_lo && temp < best->temp_lo + bucket_degc;
+    const double scale = inside ? 1.0 : std::min(1.0, pow(2.0, (best->temp_lo + bucket_degc / 2.0 - temp) / 10.0));
+    const double trefi = best->fail_trefi * scale * (1 - margin);
+    return (uint32_t)std::min(std::max(trefi, 1.0), (double)0x7fff);
+}
+
+bool RetentionProfile::save(const std::string &path, std::string *err) const {
+    std::ofstream out(path.c_str());
+    if (!out) {
+        *err = "can not write " + path;
+        return false;
+    }
+    out << "# dynamicRefresh retention profile " << PROFILE_VERSION << "\n";
+    out << "bucket_degc " << bucket_degc << "\n";
+    out << "# socket imc channel temp_lo fail_trefi hits\n";
+    for (size_t i = 0; i < chan.size(); i++) {
+        for (size_t b = 0; b < chan[i].buckets.size(); b++) {
+            const ProfileBucket &k = chan[i].buckets[b];
+            out << chan[i].socket << " " << chan[i].imc << " " << chan[i].channel << " " << k.temp_lo << " " << k.fail_trefi << " " << k.hits << "\n";
+        }
+    }
+    if (!out) {
+        *err = "can not write " + path;
+        return false;
+    }
+    return true;
+}
+
+bool RetentionProfile::load(const std::string &path, std::string *err) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        *err = "can not open " + path;
+        return false;
+    }
+    std::string line;
+    if (!std::getline(in, line) || line.find("# dynamicRefresh retention profile ") != 0 ||
+        atoi(line.c_str() + strlen("# dynamicRefresh retention profile ")) != PROFILE_VERSION) {
+        *err = path + ": not a version " + std::to_string(PROFILE_VERSION) + " retention profile";
+        return false;
+    }
+
+    RetentionProfile p;
+    for (int n = 2; std::getline(in, line); n++) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        std::string key;
+        if (line.compare(0, 12, "bucket_degc ") == 0) {
+            fields >> key >> p.bucket_degc;
+            if (!fields || p.bucket_degc == 0) {
+                *err = path + ":" + std::to_string(n) + ": bad bucket_degc";
+                return false;
+            }
+            continue;
+        }
+        ChannelLocation loc = ChannelLocation();
+        uint32_t temp_lo, fail, hits;
+        fields >> loc.socket >> loc.imc >> loc.channel >> temp_lo >> fail >> hits;
+        if (!fields || fail == 0 || fail > 0x7fff) {
+            *err = path + ":" + std::to_string(n) + ": expected socket imc channel temp_lo fail_trefi hits";
+            return false;
+        }
+        for (uint32_t h = 0; h < std::max<uint32_t>(hits, 1); h++)
+            p.record(loc, temp_lo, fail);
+    }
+    *this = p;
+    return true;
+}
+
+std::vector<uint32_t> profile_start_trefi(const RetentionProfile &profile, RegisterBackend &backend, double margin) {
+    std::vector<uint32_t> start(backend.numChannels(), 0);
+    for (int i = 0; i < backend.numChannels(); i++) {
+        uint32_t temp = 0;
+        backend.read32(i, REG_TEMP, &temp);
+        start[i] = profile.safeTrefi(backend.location(i), temp & 0xff, margin);
+    }
+    return start;
+}
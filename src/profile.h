@@ -0,0 +1,61 @@
+// Per-channel retention profile
+//
+// Written by the characterization mode (characterize.h): for every channel
+// and temperature bucket the lowest tREFI at which correctable errors showed
+// up. The controller reads it back to start every channel just below its
+// failure point instead of at base_tREFI.
+//
+// Text file, one line per channel and bucket:
+//   # dynamicRefresh retention profile 1
+//   bucket_degc 5
+//   socket imc channel temp_lo fail_trefi hits
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "topology.h"
+
+class RegisterBackend;
+
+struct ProfileBucket {
+    uint32_t temp_lo;    // bucket covers temp_lo .. temp_lo + bucket_degc - 1
+    uint32_t fail_trefi; // lowest tREFI that produced errors
+    uint32_t hits;       // sweeps that failed in this bucket
+};
+
+struct ChannelProfile {
+    uint32_t socket, imc, channel;
+    std::vector<ProfileBucket> buckets; // sorted by temp_lo
+};
+
+class RetentionProfile {
+  public:
+    explicit RetentionProfile(uint32_t bucket_degc = 5) : bucket_degc(bucket_degc) {}
+
+    void record(const ChannelLocation &loc, uint32_t temp, uint32_t fail_trefi);
+
+    // tREFI margin below the failure point at temp, 0 if the channel was
+    // never characterized. Buckets without data borrow the nearest one; a
+    // hotter temperature scales it down by retention halving every 10 degC.
+    uint32_t safeTrefi(const ChannelLocation &loc, uint32_t temp, double margin) const;
+
+    bool save(const std::string &path, std::string *err) const;
+    bool load(const std::string &path, std::string *err);
+
+    uint32_t bucketDegc() const { return bucket_degc; }
+    const std::vector<ChannelProfile> &channels() const { return chan; }
+
+  private:
+    const ChannelProfile *find(const ChannelLocation &loc) const;
+
+    uint32_t bucket_degc;
+    std::vector<ChannelProfile> chan;
+};
+
+// per-channel start tREFI from the profile at the current temperatures,
+// 0 where the profile knows nothing
+std::vector<uint32_t> profile_start_trefi(const RetentionProfile &profile, RegisterBackend &backend, double margin);
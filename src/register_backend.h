@@ -0,0 +1,71 @@
+// Register access layer for the iMC channel registers
+//
+// The controller only talks to a RegisterBackend. PcmRegisterBackend drives the
+// real PCI config space through PCM, SimRegisterBackend models the DIMMs in
+// memory so the control loop can run on any Linux box.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "topology.h"
+
+// per-channel registers used by the controller, offsets are in address.h
+enum ChannelRegister {
+    REG_TEMP = 0, // Temp_Off, temperature in [7:0]
+    REG_TREFI,    // tREFI_Off, tREFI in [14:0]
+    REG_ERR_CNT,  // Err_cnt_Off, rank 1 overflow/count in [31:16], rank 0 in [15:0]
+};
+
+// the registers the controller samples on every channel visit
+struct ChannelRegs {
+    uint32_t temp, err_cnt, trefi;
+};
+
+class RegisterBackend {
+  public:
+    explicit RegisterBackend(const Topology &t) : topo(t) {}
+    virtual ~RegisterBackend() {}
+
+    virtual const char *name() const = 0;
+
+    // channels are numbered 0..numChannels()-1 in topology order
+    int numChannels() const { return (int)topo.size(); }
+    const Topology &topology() const { return topo; }
+    const ChannelLocation &location(int channel) const { return topo[channel]; }
+
+    virtual void read32(int channel, ChannelRegister reg, uint32_t *value) = 0;
+    virtual void write32(int channel, ChannelRegister reg, uint32_t value) = 0;
+
+    // temperature, error counter and tREFI of every listed channel in one
+    // pass, in that order per channel; a backend with cheaper bulk access
+    // overrides it
+    virtual void readChannels(const int *channels, size_t n, ChannelRegs *regs) {
+        for (size_t i = 0; i < n; i++) {
+            read32(channels[i], REG_TEMP, &regs[i].temp);
+            read32(channels[i], REG_ERR_CNT, &regs[i].err_cnt);
+            read32(channels[i], REG_TREFI, &regs[i].trefi);
+        }
+    }
+
+    // read/write bandwidth in MB/s since the previous call
+    // bw[2 * channel + 0] = read, bw[2 * channel + 1] = write
+    virtual void readBandwidth(float *bw) = 0;
+
+    // monotonic time in microseconds and a wait between samples, the
+    // simulated backend advances its virtual clock instead
+    virtual uint64_t nowUs() = 0;
+    virtual void sleep(uint64_t us) = 0;
+
+    // wait until nowUs() reaches deadline_us; a backend with an absolute
+    // timer overrides it so the time spent in the loop does not add up
+    virtual void sleepUntil(uint64_t deadline_us) {
+        const uint64_t now = nowUs();
+        if (deadline_us > now)
+            sleep(deadline_us - now);
+    }
+
+  protected:
+    Topology topo;
+};
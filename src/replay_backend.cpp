@@ -0,0 +1,99 @@
+// Trace replay backend, see replay_backend.h
+
+#include <algorithm>
+
+#include "address.h"
+#include "replay_backend.h"
+
+ReplayBackend::ReplayBackend(const TraceFile &t) : RegisterBackend(t.topology()), trace(t), chan(t.topology().size()), cursor(0) {
+    start_us = trace.size() ? trace[0].time_us : 0;
+    end_us = trace.size() ? trace[trace.size() - 1].time_us : 0;
+    now_us = start_us;
+    for (size_t i = 0; i < chan.size(); i++) {
+        Channel &c = chan[i];
+        c.temp = 0;
+        c.read_mbps = c.write_mbps = 0;
+        c.trefi_reg = trace.header().base_trefi ? trace.header().base_trefi : base_tREFI;
+        c.rec_err[0] = c.rec_err[1] = 0;
+        c.err_cnt[0] = c.err_cnt[1] = 0;
+        c.err_ovf[0] = c.err_ovf[1] = false;
+    }
+    advance();
+}
+
+void ReplayBackend::advance() {
+    for (; cursor < trace.size() && trace[cursor].time_us <= now_us; cursor++) {
+        const TelemetryRecord &r = trace[cursor];
+        if (r.channel >= chan.size())
+            continue;
+        Channel &c = chan[r.channel];
+        c.read_mbps = r.read_mbps;
+        c.write_mbps = r.write_mbps;
+        if (r.reason == REASON_INIT || r.reason == REASON_BW_RESET)
+            continue;
+
+        c.temp = r.temp;
+        c.stats.recorded_samples++;
+        c.stats.recorded_trefi_sum += r.trefi_after;
+
+        // would the recorded errors also have happened at the replayed tREFI
+        const bool exposed = (c.trefi_reg & 0x7fff) >= r.trefi_before;
+        const uint32_t cnt[2] = {r.err_r0, r.err_r1};
+        const bool ovf[2] = {(r.flags & TELEMETRY_R0_OVF) != 0, (r.flags & TELEMETRY_R1_OVF) != 0};
+        for (int k = 0; k < 2; k++) {
+            const uint32_t delta = cnt[k] >= c.rec_err[k] ? cnt[k] - c.rec_err[k] : cnt[k]; // cleared counter
+            c.rec_err[k] = cnt[k];
+            if (!exposed) {
+                c.stats.errors_avoided += delta;
+                continue;
+            }
+            c.stats.errors_seen += delta;
+            c.err_cnt[k] = std::min<uint32_t>(c.err_cnt[k] + delta, 0x7fff);
+            c.err_ovf[k] = c.err_ovf[k] || ovf[k];
+        }
+    }
+}
+
+void ReplayBackend::read32(int channel, ChannelRegister reg, uint32_t *value) {
+    const Channel &c = chan[channel];
+    switch (reg) {
+    case REG_TEMP:
+        *value = c.temp & 0xff;
+        break;
+    case REG_TREFI:
+        *value = c.trefi_reg;
+        break;
+    case REG_ERR_CNT:
+        *value = ((uint32_t)c.err_ovf[1] << 31) | (c.err_cnt[1] << 16) | ((uint32_t)c.err_ovf[0] << 15) | c.err_cnt[0];
+        break;
+    }
+}
+
+void ReplayBackend::write32(int channel, ChannelRegister reg, uint32_t value) {
+    Channel &c = chan[channel];
+    switch (reg) {
+    case REG_TEMP:
+        break; // read only
+    case REG_TREFI:
+        c.trefi_reg = value;
+        break;
+    case REG_ERR_CNT:
+        c.err_ovf[1] = (value >> 31) & 0x1;
+        c.err_cnt[1] = (value >> 16) & 0x7fff;
+        c.err_ovf[0] = (value >> 15) & 0x1;
+        c.err_cnt[0] = value & 0x7fff;
+        break;
+    }
+}
+
+void ReplayBackend::readBandwidth(float *bw) {
+    for (size_t i = 0; i < chan.size(); i++) {
+        bw[i * 2 + 0] = chan[i].read_mbps;
+        bw[i * 2 + 1] = chan[i].write_mbps;
+    }
+}
+
+void ReplayBackend::sleep(uint64_t us) {
+    now_us += us;
+    advance();
+}
@@ -0,0 +1,61 @@
+// Replays a recorded trace as register contents
+//
+// Temperature and bandwidth come straight from the trace. The tREFI register
+// starts at the base_trefi of the trace header and then holds whatever the
+// controller under test wrote. Recorded errors only show up in the error
+// counters when the replayed tREFI is at least the recorded one at that
+// sample; otherwise they count as avoided.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "register_backend.h"
+#include "trace.h"
+
+struct ReplayChannelStats {
+    uint64_t recorded_samples;
+    uint64_t recorded_trefi_sum;
+    uint64_t errors_seen;    // recorded errors passed on to the controller
+    uint64_t errors_avoided; // recorded errors at a tREFI above the replayed one
+
+    ReplayChannelStats() : recorded_samples(0), recorded_trefi_sum(0), errors_seen(0), errors_avoided(0) {}
+};
+
+class ReplayBackend : public RegisterBackend {
+  public:
+    explicit ReplayBackend(const TraceFile &trace);
+
+    const char *name() const { return "replay"; }
+
+    void read32(int channel, ChannelRegister reg, uint32_t *value);
+    void write32(int channel, ChannelRegister reg, uint32_t value);
+    void readBandwidth(float *bw);
+    uint64_t nowUs() { return now_us; }
+    void sleep(uint64_t us);
+
+    uint64_t startUs() const { return start_us; }
+    uint64_t endUs() const { return end_us; }
+    size_t replayed() const { return cursor; }
+    const ReplayChannelStats &stats(int channel) const { return chan[channel].stats; }
+
+  private:
+    struct Channel {
+        uint32_t temp;
+        float read_mbps, write_mbps;
+        uint32_t trefi_reg;
+        uint32_t rec_err[2]; // last recorded counters
+        uint32_t err_cnt[2]; // counters shown to the controller
+        bool err_ovf[2];
+        ReplayChannelStats stats;
+    };
+
+    void advance();
+
+    const TraceFile &trace;
+    std::vector<Channel> chan;
+    size_t cursor;
+    uint64_t start_us, end_us, now_us;
+};
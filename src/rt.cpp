@@ -0,0 +1,41 @@
+// Real-time mode of the control thread, see rt.h
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+
+bool enter_rt_mode(const RtOptions &opt, std::string *err) {
+    if (opt.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        *err = std::string("mlockall: ") + strerror(errno);
+        return false;
+    }
+    if (opt.cpu >= 0) {
+        if (opt.cpu >= CPU_SETSIZE) {
+            *err = "cpu " + std::to_string(opt.cpu) + " is out of range";
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(opt.cpu, &set);
+        const int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) {
+            *err = "pinning to cpu " + std::to_string(opt.cpu) + ": " + strerror(rc);
+            return false;
+        }
+    }
+    if (opt.priority > 0) {
+        struct sched_param sp;
+        memset(&sp, 0, sizeof(sp));
+        sp.sched_priority = opt.priority;
+        const int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+        if (rc != 0) {
+            *err = "SCHED_FIFO priority " + std::to_string(opt.priority) + ": " + strerror(rc);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+// Real-time mode of the control thread
+//
+// Under heavy host load the daemon can be descheduled right when the DIMMs
+// heat up. enter_rt_mode() moves the calling thread to SCHED_FIFO, pins it
+// to one (housekeeping) CPU and locks the process memory so a sample never
+// waits on a page fault. Threads started afterwards inherit the policy and
+// the affinity, so call it from the control thread once the telemetry and
+// metrics threads are running.
+
+#pragma once
+
+#include <string>
+
+struct RtOptions {
+    int priority;     // SCHED_FIFO priority 1..99, 0 keeps the normal scheduler
+    int cpu;          // CPU to pin the control thread to, -1 for none
+    bool lock_memory; // mlockall() current and future pages
+
+    RtOptions() : priority(0), cpu(-1), lock_memory(false) {}
+};
+
+// false with the reason on the first step that fails (usually missing
+// CAP_SYS_NICE / CAP_IPC_LOCK), the steps before it stay in effect
+bool enter_rt_mode(const RtOptions &opt, std::string *err);
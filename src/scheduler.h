@@ -0,0 +1,37 @@
+// Deadline scheduler for the per-channel samples
+//
+// Every channel (and the bandwidth sampler) sits in the queue exactly once
+// with the absolute time of its next sample, the control loop sleeps until
+// the earliest deadline and handles everything that is due.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+class SampleScheduler {
+  public:
+    SampleScheduler() {}
+
+    bool empty() const { return queue.empty(); }
+    uint64_t nextDeadline() const { return queue.top().first; }
+
+    void schedule(int id, uint64_t deadline_us) { queue.push(Entry(deadline_us, id)); }
+
+    // removes every id due at now_us, earliest first
+    void popDue(uint64_t now_us, std::vector<int> *due) {
+        due->clear();
+        while (!queue.empty() && queue.top().first <= now_us) {
+            due->push_back(queue.top().second);
+            queue.pop();
+        }
+    }
+
+  private:
+    typedef std::pair<uint64_t, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+};
@@ -0,0 +1,162 @@
+// Simulated DIMM backend, see sim_backend.h
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "address.h"
+#include "sim_backend.h"
+
+#define SIM_MAX_STEP_US 100000 // integrate the model in steps of at most 100 ms
+
+SimDimmParams::SimDimmParams() : ambient(35.0), heat_per_gbps(2.5), thermal_tau(30.0), err_rate(2.0), trfc(0x147) {
+    retention[0] = 3.2 * base_tREFI;
+    retention[1] = 3.6 * base_tREFI;
+}
+
+SimRegisterBackend::SimRegisterBackend(const Topology &t, uint32_t seed) : RegisterBackend(t), dimms(t.size()), trace_period_ms(0), now_us(0), rng(seed) {
+    std::uniform_real_distribution<double> spread(0.95, 1.05);
+    for (size_t i = 0; i < dimms.size(); i++) {
+        Dimm &d = dimms[i];
+        // every DIMM gets slightly different weak cells
+        d.p.retention[0] *= spread(rng);
+        d.p.retention[1] *= spread(rng);
+        d.temp = d.p.ambient;
+        d.read_mbps = d.write_mbps = 0;
+        d.trefi_reg = (d.p.trfc << 15) | base_tREFI;
+        d.err_cnt[0] = d.err_cnt[1] = 0;
+        d.err_ovf[0] = d.err_ovf[1] = false;
+        d.injected = 0;
+    }
+    updateBandwidth();
+}
+
+bool SimRegisterBackend::loadBandwidthTrace(const std::string &path) {
+    std::ifstream in(path.c_str());
+    if (!in)
+        return false;
+
+    std::vector<std::vector<TraceSample>> t(dimms.size());
+    std::string line;
+    while (std::getline(in, line)) {
+        unsigned long long t_ms;
+        int ch;
+        float rd, wr;
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (sscanf(line.c_str(), "%llu,%d,%f,%f", &t_ms, &ch, &rd, &wr) != 4)
+            continue; // header or garbage
+        if (ch < 0 || ch >= (int)dimms.size())
+            continue;
+        TraceSample s = {t_ms, rd, wr};
+        t[ch].push_back(s);
+        trace_period_ms = std::max<uint64_t>(trace_period_ms, t_ms + 1);
+    }
+    for (size_t i = 0; i < t.size(); i++)
+        std::sort(t[i].begin(), t[i].end(), [](const TraceSample &a, const TraceSample &b) { return a.t_ms < b.t_ms; });
+    trace.swap(t);
+    updateBandwidth();
+    return true;
+}
+
+void SimRegisterBackend::updateBandwidth() {
+    const uint64_t now_ms = now_us / 1000;
+    for (size_t i = 0; i < dimms.size(); i++) {
+        Dimm &d = dimms[i];
+        if (!trace.empty()) {
+            const std::vector<TraceSample> &t = trace[i];
+            if (t.empty()) {
+                d.read_mbps = d.write_mbps = 0;
+                continue;
+            }
+            const uint64_t pos = now_ms % trace_period_ms;
+            std::vector<TraceSample>::const_iterator it =
+                std::upper_bound(t.begin(), t.end(), pos, [](uint64_t v, const TraceSample &s) { return v < s.t_ms; });
+            if (it != t.begin())
+                --it;
+            d.read_mbps = it->read_mbps;
+            d.write_mbps = it->write_mbps;
+        } else {
+            // synthetic 40 s idle/heavy phases, shifted by 5 s per channel
+            const bool heavy = ((now_ms + i * 5000) % 40000) >= 20000;
+            d.read_mbps = heavy ? 6000 : 200;
+            d.write_mbps = heavy ? 2500 : 50;
+        }
+    }
+}
+
+void SimRegisterBackend::step(double dt) {
+    updateBandwidth();
+    for (size_t i = 0; i < dimms.size(); i++) {
+        Dimm &d = dimms[i];
+        const double target = d.p.ambient + d.p.heat_per_gbps * (d.read_mbps + d.write_mbps) / 1000.0;
+        d.temp += (target - d.temp) * (1.0 - exp(-dt / d.p.thermal_tau));
+
+        // retention time roughly halves every 10 degC
+        const double trefi = d.trefi_reg & 0x7fff;
+        for (int r = 0; r < 2; r++) {
+            const double thr = d.p.retention[r] * pow(2.0, (45.0 - d.temp) / 10.0);
+            if (trefi <= thr)
+                continue;
+            std::poisson_distribution<uint32_t> errors(d.p.err_rate * (trefi / thr - 1.0) * 100.0 * dt);
+            const uint32_t n = errors(rng);
+            d.injected += n;
+            d.err_cnt[r] += n;
+            if (d.err_cnt[r] > 0x7fff) {
+                d.err_cnt[r] = 0x7fff;
+                d.err_ovf[r] = true;
+            }
+        }
+    }
+}
+
+void SimRegisterBackend::read32(int channel, ChannelRegister reg, uint32_t *value) {
+    const Dimm &d = dimms[channel];
+    switch (reg) {
+    case REG_TEMP:
+        *value = (uint32_t)lround(std::max(0.0, d.temp)) & 0xff;
+        break;
+    case REG_TREFI:
+        *value = d.trefi_reg;
+        break;
+    case REG_ERR_CNT:
+        *value = ((uint32_t)d.err_ovf[1] << 31) | (d.err_cnt[1] << 16) | ((uint32_t)d.err_ovf[0] << 15) | d.err_cnt[0];
+        break;
+    }
+}
+
+void SimRegisterBackend::write32(int channel, ChannelRegister reg, uint32_t value) {
+    Dimm &d = dimms[channel];
+    switch (reg) {
+    case REG_TEMP:
+        break; // read only
+    case REG_TREFI:
+        d.trefi_reg = value;
+        break;
+    case REG_ERR_CNT:
+        d.err_ovf[1] = (value >> 31) & 0x1;
+        d.err_cnt[1] = (value >> 16) & 0x7fff;
+        d.err_ovf[0] = (value >> 15) & 0x1;
+        d.err_cnt[0] = value & 0x7fff;
+        break;
+    }
+}
+
+void SimRegisterBackend::readBandwidth(float *bw) {
+    for (size_t i = 0; i < dimms.size(); i++) {
+        bw[i * 2 + 0] = dimms[i].read_mbps;
+        bw[i * 2 + 1] = dimms[i].write_mbps;
+    }
+}
+
+void SimRegisterBackend::sleep(uint64_t us) {
+    while (us > 0) {
+        const uint64_t dt = std::min<uint64_t>(us, SIM_MAX_STEP_US);
+        now_us += dt;
+        us -= dt;
+        step(dt / 1e6);
+    }
+}
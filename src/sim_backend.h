@@ -0,0 +1,71 @@
+// Simulated DIMM backend
+//
+// Models per channel temperature (first order thermal response to the
+// bandwidth), retention errors as a function of tREFI and temperature, and a
+// bandwidth trace (synthetic idle/heavy phases or loaded from a csv file).
+// The clock is virtual, sleep() only advances the model.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "register_backend.h"
+
+struct SimDimmParams {
+    double ambient;         // degC with an idle channel
+    double heat_per_gbps;   // degC above ambient per GB/s of traffic
+    double thermal_tau;     // seconds
+    double retention[2];    // per rank tREFI (clk) at 45 degC where errors start
+    double err_rate;        // errors/s per 1% of tREFI above the retention point
+    uint32_t trfc;          // tRFC field kept in the upper bits of the tREFI register
+
+    SimDimmParams();
+};
+
+class SimRegisterBackend : public RegisterBackend {
+  public:
+    SimRegisterBackend(const Topology &t, uint32_t seed);
+
+    const char *name() const { return "sim"; }
+
+    void read32(int channel, ChannelRegister reg, uint32_t *value);
+    void write32(int channel, ChannelRegister reg, uint32_t value);
+    void readBandwidth(float *bw);
+    uint64_t nowUs() { return now_us; }
+    void sleep(uint64_t us);
+
+    // csv lines "time_ms,channel,read_mbps,write_mbps", replayed in a loop
+    bool loadBandwidthTrace(const std::string &path);
+    SimDimmParams &params(int channel) { return dimms[channel].p; }
+
+    double temperature(int channel) const { return dimms[channel].temp; }
+    uint64_t injectedErrors(int channel) const { return dimms[channel].injected; }
+
+  private:
+    struct Dimm {
+        SimDimmParams p;
+        double temp;
+        float read_mbps, write_mbps;
+        uint32_t trefi_reg;
+        uint32_t err_cnt[2];
+        bool err_ovf[2];
+        uint64_t injected;
+    };
+    struct TraceSample {
+        uint64_t t_ms;
+        float read_mbps, write_mbps;
+    };
+
+    void updateBandwidth();
+    void step(double dt);
+
+    std::vector<Dimm> dimms;
+    std::vector<std::vector<TraceSample>> trace; // per channel, sorted by time
+    uint64_t trace_period_ms;
+    uint64_t now_us;
+    std::mt19937 rng;
+};
@@ -0,0 +1,106 @@
+// Controller telemetry, see telemetry.h
+
+#include <string.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+#include "trace.h"
+
+#define TELEMETRY_IDLE_US 10000 // consumer poll period when the ring is empty
+
+static const char *reason_names[NUM_REASONS] = {"inc", "at_limit", "err", "err_clear", "bw_reset", "init"};
+
+const char *reason_name(uint8_t reason) { return reason < NUM_REASONS ? reason_names[reason] : "unknown"; }
+
+bool parse_telemetry_format(const char *name, TelemetryFormat *format) {
+    if (strcmp(name, "text") == 0)
+        *format = TELEMETRY_TEXT;
+    else if (strcmp(name, "csv") == 0)
+        *format = TELEMETRY_CSV;
+    else if (strcmp(name, "binary") == 0)
+        *format = TELEMETRY_BINARY;
+    else
+        return false;
+    return true;
+}
+
+Telemetry::Telemetry(const Topology &t, TelemetryFormat f, FILE *o, size_t capacity)
+    : topo(t), format(f), out(o), mask(0), head(0), tail(0), drops(0), running(false) {
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    ring.resize(size);
+    mask = size - 1;
+}
+
+Telemetry::~Telemetry() { stop(); }
+
+void Telemetry::start(uint32_t base_trefi) {
+    if (running.exchange(true))
+        return;
+    if (format == TELEMETRY_BINARY)
+        write_trace_header(out, topo, base_trefi);
+    else if (format == TELEMETRY_CSV)
+        fprintf(out, "time_us,socket,imc,channel,temp,r1_ovf,r1_err,r0_ovf,r0_err,trefi_before,trefi_after,limit,read_mbps,write_mbps,reason\n");
+    worker = std::thread(&Telemetry::run, this);
+}
+
+void Telemetry::stop() {
+    if (!running.exchange(false))
+        return;
+    worker.join();
+    drain();
+    fflush(out);
+}
+
+bool Telemetry::push(const TelemetryRecord &rec) {
+    const uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) > mask) {
+        drops.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    ring[h & mask] = rec;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+size_t Telemetry::drain() {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    const uint64_t h = head.load(std::memory_order_acquire);
+    const size_t n = h - t;
+    for (; t != h; t++) {
+        write(ring[t & mask]);
+        tail.store(t + 1, std::memory_order_release);
+    }
+    return n;
+}
+
+void Telemetry::run() {
+    while (running.load(std::memory_order_relaxed)) {
+        if (drain())
+            fflush(out);
+        else
+            usleep(TELEMETRY_IDLE_US);
+    }
+}
+
+void Telemetry::write(const TelemetryRecord &r) {
+    const ChannelLocation &loc = topo[r.channel];
+    const unsigned r1_ovf = (r.flags & TELEMETRY_R1_OVF) ? 1 : 0;
+    const unsigned r0_ovf = (r.flags & TELEMETRY_R0_OVF) ? 1 : 0;
+
+    switch (format) {
+    case TELEMETRY_TEXT:
+        fprintf(out, " %s %.3fs temp %u, rank 1 err %u ovf %u, rank 0 err %u ovf %u, tREFI(ck) %u -> %u limit %u, bw %.1f - %.1f MB/s, %s\n",
+                channel_name(loc).c_str(), r.time_us / 1e6, r.temp, r.err_r1, r1_ovf, r.err_r0, r0_ovf, r.trefi_before, r.trefi_after, r.limit,
+                r.read_mbps, r.write_mbps, reason_name(r.reason));
+        break;
+    case TELEMETRY_CSV:
+        fprintf(out, "%llu,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%.1f,%.1f,%s\n", (unsigned long long)r.time_us, loc.socket, loc.imc, loc.channel, r.temp,
+                r1_ovf, r.err_r1, r0_ovf, r.err_r0, r.trefi_before, r.trefi_after, r.limit, r.read_mbps, r.write_mbps, reason_name(r.reason));
+        break;
+    case TELEMETRY_BINARY:
+        fwrite(&r, sizeof(r), 1, out);
+        break;
+    }
+}
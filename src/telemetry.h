@@ -0,0 +1,85 @@
+// Controller telemetry
+//
+// The control loop pushes fixed-size records into a single-producer/
+// single-consumer ring and never waits for I/O. A background thread drains
+// the ring and formats the records as text, csv or raw binary.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "topology.h"
+
+// why a sample ended with its tREFI
+enum DecisionReason {
+    REASON_INC = 0,    // no error, tREFI increased
+    REASON_AT_LIMIT,   // no error, clamped to the temperature limit
+    REASON_ERR,        // error detected, tREFI decreased
+    REASON_ERR_CLEAR,  // error flag cleared, tREFI decreased once more
+    REASON_BW_RESET,   // heavy bandwidth phase, tREFI halved
+    REASON_INIT,       // startup value
+    NUM_REASONS
+};
+
+enum TelemetryFormat { TELEMETRY_TEXT, TELEMETRY_CSV, TELEMETRY_BINARY };
+
+const char *reason_name(uint8_t reason);
+
+// "text", "csv" or "binary", returns false for anything else
+bool parse_telemetry_format(const char *name, TelemetryFormat *format);
+
+#define TELEMETRY_R0_OVF 0x1
+#define TELEMETRY_R1_OVF 0x2
+
+struct TelemetryRecord {
+    uint64_t time_us;
+    uint16_t channel; // index in the topology
+    uint8_t reason;   // DecisionReason
+    uint8_t flags;    // TELEMETRY_*_OVF
+    uint32_t temp;
+    uint32_t err_r0, err_r1;
+    uint32_t trefi_before, trefi_after;
+    uint32_t limit;
+    float read_mbps, write_mbps;
+    uint32_t reserved;
+};
+
+// also the record of the binary trace format, see trace.h
+static_assert(sizeof(TelemetryRecord) == 48, "TelemetryRecord layout is part of the trace format");
+
+class Telemetry {
+  public:
+    // capacity is rounded up to a power of two
+    Telemetry(const Topology &topo, TelemetryFormat format, FILE *out, size_t capacity = 1 << 14);
+    ~Telemetry();
+
+    void start(uint32_t base_trefi); // base_trefi of the run, for the binary trace header
+    void stop(); // drains what is left
+
+    // producer side, drops the record when the ring is full
+    bool push(const TelemetryRecord &rec);
+
+    uint64_t dropped() const { return drops.load(std::memory_order_relaxed); }
+
+  private:
+    void run();
+    size_t drain();
+    void write(const TelemetryRecord &rec);
+
+    Topology topo;
+    TelemetryFormat format;
+    FILE *out;
+
+    std::vector<TelemetryRecord> ring;
+    size_t mask;
+    alignas(64) std::atomic<uint64_t> head; // next slot the producer writes
+    alignas(64) std::atomic<uint64_t> tail; // next slot the consumer reads
+    alignas(64) std::atomic<uint64_t> drops;
+    std::atomic<bool> running;
+    std::thread worker;
+};
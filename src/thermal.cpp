@@ -0,0 +1,76 @@
+// Online thermal model, see thermal.h
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "thermal.h"
+
+#define THERMAL_P0 1000.0     // initial RLS covariance, little trust in the zero start
+#define THERMAL_P_MAX 1e6     // covariance trace that counts as wind up under constant input
+#define THERMAL_MAX_SWING 20.0 // degC the forecast may move away from the reading
+
+ThermalModel::ThermalModel() : bw_gbps(0), bw_sum(0), anchor_us(0), last_us(0), anchor_temp(0), fits(0), predicted(0) {
+    for (int i = 0; i < 3; i++) {
+        c[i] = 0;
+        for (int j = 0; j < 3; j++)
+            P[i][j] = i == j ? THERMAL_P0 : 0;
+    }
+}
+
+double ThermalModel::update(const ThermalParams &p, uint64_t time_us, double temp) {
+    if (last_us == 0 || time_us <= last_us) {
+        anchor_us = last_us = time_us;
+        anchor_temp = predicted = temp;
+        bw_sum = 0;
+        return temp;
+    }
+    bw_sum += bw_gbps * (time_us - last_us) / 1e6;
+    last_us = time_us;
+
+    const double span = (time_us - anchor_us) / 1e6;
+    if (span >= p.fit_dt_s) {
+        const double x[3] = {1, bw_sum / span, (temp + anchor_temp) / 2};
+        const double y = (temp - anchor_temp) / span;
+
+        // recursive least squares step with forgetting
+        double Px[3], xPx = 0, err = y;
+        for (int i = 0; i < 3; i++) {
+            Px[i] = P[i][0] * x[0] + P[i][1] * x[1] + P[i][2] * x[2];
+            xPx += x[i] * Px[i];
+            err -= c[i] * x[i];
+        }
+        const double lambda = p.forgetting;
+        const double denom = lambda + xPx;
+        double trace = 0;
+        for (int i = 0; i < 3; i++) {
+            c[i] += Px[i] / denom * err;
+            for (int j = 0; j < 3; j++)
+                P[i][j] = (P[i][j] - Px[i] * Px[j] / denom) / lambda;
+            trace += P[i][i];
+        }
+        if (trace > THERMAL_P_MAX) {
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++)
+                    P[i][j] *= THERMAL_P_MAX / trace;
+        }
+        fits++;
+        anchor_us = time_us;
+        anchor_temp = temp;
+        bw_sum = 0;
+    }
+
+    if (fits < p.warmup) {
+        predicted = temp;
+        return predicted;
+    }
+    const double drive = c[0] + c[1] * bw_gbps;
+    if (c[2] < -1e-4) {
+        const double steady = -drive / c[2];
+        predicted = steady + (temp - steady) * exp(c[2] * p.horizon_s);
+    } else {
+        predicted = temp + (drive + c[2] * temp) * p.horizon_s; // no usable time constant yet, extrapolate the slope
+    }
+    predicted = std::min(std::max(predicted, temp - THERMAL_MAX_SWING), temp + THERMAL_MAX_SWING);
+    return predicted;
+}
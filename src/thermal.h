@@ -0,0 +1,46 @@
+// Online thermal model of one channel
+//
+// First order response of the DIMM temperature to its bandwidth:
+//   dT/dt = c0 + c1 * bw + c2 * T
+// (c2 = -1 / tau, steady state -(c0 + c1 * bw) / c2). The coefficients are
+// fitted by recursive least squares with exponential forgetting on slopes
+// taken over at least fit_dt_s, because a 1 degC register makes the slope of
+// two close samples mostly quantization noise. The forecast integrates the
+// model over the horizon with the bandwidth held at its latest value.
+
+#pragma once
+
+#include <stdint.h>
+
+struct ThermalParams {
+    double horizon_s;  // forecast this far ahead
+    double fit_dt_s;   // shortest span a slope is measured over
+    double forgetting; // RLS forgetting factor per slope, 1 never forgets
+    double warmup;     // slopes before the forecast is trusted
+
+    ThermalParams() : horizon_s(5), fit_dt_s(1), forgetting(0.995), warmup(10) {}
+};
+
+class ThermalModel {
+  public:
+    ThermalModel();
+
+    void bandwidth(double mbps) { bw_gbps = mbps / 1000.0; }
+
+    // temperature sample, returns the forecast horizon_s ahead (temp itself
+    // until the model has warmed up)
+    double update(const ThermalParams &p, uint64_t time_us, double temp);
+
+    double forecast() const { return predicted; }
+    double tau() const { return c[2] < 0 ? -1 / c[2] : 0; } // s, 0 while unknown
+
+  private:
+    double c[3];    // dT/dt coefficients of 1, bw (GB/s), T
+    double P[3][3]; // RLS covariance
+    double bw_gbps;
+    double bw_sum;  // bandwidth integral since the anchor, GB/s * s
+    uint64_t anchor_us, last_us;
+    double anchor_temp;
+    uint64_t fits;
+    double predicted;
+};
@@ -0,0 +1,205 @@
+// DRAM timing discovery, see timing.h
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "checkpoint.h"
+#include "config.h"
+#include "timing.h"
+
+#define TREFI_NS 7800 // JEDEC average refresh interval below 85 degC
+
+// JEDEC speed bins, the x66/x33 ones are 1866.67, 2133.33, ...
+static const uint32_t speed_bins[] = {1066, 1333, 1600, 1866, 2133, 2400, 2666, 2933, 3200};
+
+// the exact transfer rate of a bin, 1866 runs at 1866.67
+static double bin_mts(uint32_t mts) { return lround(mts * 3 / 100.0) * 100 / 3.0; }
+
+double dram_tck_ns(uint32_t mts) { return 2000 / bin_mts(mts); }
+
+static uint16_t word(const uint8_t *p) { return p[0] | p[1] << 8; }
+
+// string n (1 based) of an SMBIOS structure, empty when it has none
+static std::string smbios_string(const uint8_t *raw, size_t len, uint8_t n) {
+    size_t off = raw[1];
+    for (uint8_t i = 1; n && off < len && raw[off]; i++) {
+        const char *s = (const char *)raw + off;
+        const size_t l = strnlen(s, len - off);
+        if (i == n)
+            return std::string(s, l);
+        off += l + 1;
+    }
+    return "";
+}
+
+bool read_smbios_dimms(const std::string &dir, std::vector<DimmInfo> *dimms, std::string *err) {
+    dimms->clear();
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        *err = "can not open " + dir;
+        return false;
+    }
+    std::vector<std::string> entries;
+    while (struct dirent *e = readdir(d)) {
+        if (strncmp(e->d_name, "17-", 3) == 0)
+            entries.push_back(e->d_name);
+    }
+    closedir(d);
+    std::sort(entries.begin(), entries.end());
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        FILE *f = fopen((dir + "/" + entries[i] + "/raw").c_str(), "rb");
+        if (!f)
+            continue;
+        uint8_t raw[512];
+        const size_t len = fread(raw, 1, sizeof(raw), f);
+        fclose(f);
+        // formatted area up to the speed field, SMBIOS 2.3
+        if (len < 0x17 || raw[0] != 17 || raw[1] < 0x17 || raw[1] > len)
+            continue;
+
+        DimmInfo dimm;
+        const uint16_t size = word(raw + 0x0c);
+        if (size == 0x7fff && raw[1] >= 0x20)
+            dimm.size_mb = (word(raw + 0x1c) | (uint32_t)word(raw + 0x1e) << 16) & 0x7fffffff;
+        else if (size == 0xffff)
+            dimm.size_mb = 0;
+        else
+            dimm.size_mb = size & 0x8000 ? (size & 0x7fff) / 1024 : size;
+        dimm.locator = smbios_string(raw, len, raw[0x10]);
+        dimm.bank = smbios_string(raw, len, raw[0x11]);
+        dimm.type = raw[0x12];
+        dimm.speed_mts = word(raw + 0x15);
+        dimm.ranks = raw[1] >= 0x1c ? raw[0x1b] & 0xf : 0;
+        dimm.configured_mts = raw[1] >= 0x22 ? word(raw + 0x20) : 0;
+        if (dimm.speed_mts == 0xffff)
+            dimm.speed_mts = 0;
+        if (dimm.configured_mts == 0xffff)
+            dimm.configured_mts = 0;
+        dimms->push_back(dimm);
+    }
+    if (dimms->empty()) {
+        *err = "no memory devices in " + dir;
+        return false;
+    }
+    return true;
+}
+
+uint32_t dimm_speed_mts(const std::vector<DimmInfo> &dimms) {
+    uint32_t mts = 0;
+    for (size_t i = 0; i < dimms.size(); i++) {
+        if (!dimms[i].size_mb)
+            continue;
+        const uint32_t s = dimms[i].configured_mts ? dimms[i].configured_mts : dimms[i].speed_mts;
+        if (s && (!mts || s < mts))
+            mts = s;
+    }
+    return mts;
+}
+
+// 7.8 us in clocks of a bin, what the BIOS programs
+static uint32_t bios_trefi(uint32_t mts) { return std::min<uint32_t>(lround(TREFI_NS / dram_tck_ns(mts)), 0x7fff); }
+
+// the bin whose BIOS value the tREFI field holds (to a clock), 0 for none
+static uint32_t mts_of_trefi(uint32_t trefi) {
+    for (size_t i = 0; trefi && i < sizeof(speed_bins) / sizeof(speed_bins[0]); i++) {
+        const uint32_t bios = bios_trefi(speed_bins[i]);
+        if (trefi + 1 >= bios && trefi <= bios + 1)
+            return speed_bins[i];
+    }
+    return 0;
+}
+
+// the slowest bin of a memory type; the supported iMCs (Haswell-EP and
+// Broadwell-EP) only run DDR4, so that is the default
+static uint32_t slowest_mts(uint32_t memory_type) { return memory_type == SMBIOS_DDR3 ? 1066 : 1600; }
+
+ChannelTiming channel_timing(uint32_t mts, uint32_t trefi_reg, const ClockFallback &fallback) {
+    ChannelTiming t;
+    t.source = "smbios";
+    if (!mts && fallback.trust_register) {
+        mts = mts_of_trefi(trefi_reg & 0x7fff);
+        t.source = "register";
+    } else if (!mts && fallback.checkpoint_mts) {
+        mts = fallback.checkpoint_mts;
+        t.source = "checkpoint";
+    }
+    // assuming a faster clock than the DIMMs run would under-refresh them
+    if (!mts) {
+        mts = slowest_mts(fallback.memory_type);
+        t.source = "slowest";
+    }
+    t.mts = mts;
+    t.dram.tck_ns = dram_tck_ns(mts);
+    t.dram.trfc_ck = (trefi_reg >> 15) & 0x1ff;
+
+    t.base_trefi = bios_trefi(mts);
+    t.min_trefi = t.base_trefi / 2;
+    t.max_trefi = std::min<uint32_t>(4 * t.base_trefi, 0x7fff);
+    return t;
+}
+
+ClockFallback clock_fallback(const RefreshConfig &cfg) {
+    ClockFallback f;
+    f.trust_register = cfg.checkpoint.empty() || access(cfg.checkpoint.c_str(), F_OK) != 0;
+    Checkpoint previous;
+    std::string err;
+    if (!f.trust_register && previous.load(cfg.checkpoint, &err))
+        f.checkpoint_mts = checkpoint_dram_mts(previous);
+    return f;
+}
+
+std::vector<ChannelTiming> discover_timing(RegisterBackend &backend, const std::string &smbios_dir, ClockFallback fallback) {
+    std::vector<DimmInfo> dimms;
+    std::string err;
+    const uint32_t mts = !smbios_dir.empty() && read_smbios_dimms(smbios_dir, &dimms, &err) ? dimm_speed_mts(dimms) : 0;
+    for (size_t i = 0; i < dimms.size() && !fallback.memory_type; i++) {
+        if (dimms[i].size_mb)
+            fallback.memory_type = dimms[i].type;
+    }
+    std::vector<ChannelTiming> timing;
+    for (int i = 0; i < backend.numChannels(); i++) {
+        uint32_t reg = 0;
+        backend.read32(i, REG_TREFI, &reg);
+        timing.push_back(channel_timing(mts, reg, fallback));
+    }
+    return timing;
+}
+
+void apply_timing(const std::vector<ChannelTiming> &timing, RefreshConfig *defaults) {
+    for (size_t i = 0; i < timing.size(); i++) {
+        if (i == 0 || timing[i].base_trefi < defaults->base_trefi) {
+            defaults->base_trefi = timing[i].base_trefi;
+            defaults->dram_mts = timing[i].mts;
+        }
+    }
+}
+
+void apply_timing(const std::vector<ChannelTiming> &timing, ControllerOptions *opt) {
+    opt->min_trefi.resize(timing.size());
+    opt->max_trefi.resize(timing.size());
+    for (size_t i = 0; i < timing.size(); i++) {
+        opt->min_trefi[i] = timing[i].min_trefi;
+        opt->max_trefi[i] = timing[i].max_trefi;
+    }
+}
+
+void print_timing(std::ostream &out, RegisterBackend &backend, const std::vector<ChannelTiming> &timing) {
+    bool slowest = false;
+    for (size_t i = 0; i < timing.size(); i++) {
+        const ChannelTiming &t = timing[i];
+        char buf[256];
+        snprintf(buf, sizeof(buf), " %s: %u MT/s (%s), tCK %.4f ns, tRFC(ck) %u", channel_name(backend.location(i)).c_str(), t.mts, t.source, t.dram.tck_ns,
+                 t.dram.trfc_ck);
+        out << buf;
+        out << ", tREFI(ck) base " << t.base_trefi << " min " << t.min_trefi << " max " << t.max_trefi << "\n";
+        slowest |= strcmp(t.source, "slowest") == 0;
+    }
+    if (slowest)
+        out << " DRAM clock unknown, base tREFI assumes the slowest speed bin; set base_trefi and dram_mts for this host\n";
+}
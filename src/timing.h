@@ -0,0 +1,102 @@
+// DRAM timing discovery
+//
+// base_tREFI 7280 is 7.8 us at 1866 MT/s (tCK 1.0714 ns). Other speed bins
+// need other clock counts for the same interval: 2133 takes 8320, 2400 9360,
+// 2666 10400 and 2933 11440. At startup the daemon reads
+//   - the SMBIOS memory device entries (type 17, /sys/firmware/dmi/entries),
+//     for the configured speed of every populated DIMM
+//   - the tREFI register of every channel, whose tRFC field gives the refresh
+//     cycle time and whose tREFI field, as the BIOS left it, gives the clock
+//     when SMBIOS has no speed
+// and derives per channel, in clocks, the base tREFI (7.8 us), the safe
+// minimum (3.9 us, the 2x rate of the extended temperature range) and
+// maximum (4x base).
+//
+// The tREFI field only counts when it holds exactly a value the BIOS
+// programs and no checkpoint says this daemon ran before: a tREFI it wrote
+// (8320 at 1866 MT/s is the BIOS value of 2133) would otherwise pass for a
+// faster clock. After a restart the clock the checkpoint recorded, the one
+// the first run found, stands in for the register. With none of them the
+// slowest speed bin of the memory type is assumed, a slower DIMM is never
+// under-refreshed.
+//
+// The channels of a host run one DRAM clock, the slowest DIMM's. The config
+// defaults take the smallest base tREFI of all channels so a slower channel
+// is never under-refreshed; explicit base_trefi or dram_mts keys still win.
+// The minimum and maximum stay per channel, the controller clamps every
+// decision of a channel to its own.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "accounting.h"
+#include "register_backend.h"
+
+struct ControllerOptions;
+struct RefreshConfig;
+
+#define SMBIOS_ENTRIES "/sys/firmware/dmi/entries"
+#define SMBIOS_DDR3 0x18
+#define SMBIOS_DDR4 0x1a
+
+// one SMBIOS type 17 entry
+struct DimmInfo {
+    std::string locator, bank; // silkscreen and bank labels
+    uint32_t type;             // SMBIOS memory type, SMBIOS_DDR3 or SMBIOS_DDR4
+    uint32_t speed_mts;        // rated speed, 0 when unknown
+    uint32_t configured_mts;   // speed the BIOS runs it at, 0 when unknown
+    uint64_t size_mb;          // 0 for an empty slot
+    uint32_t ranks;            // 0 when unknown
+};
+
+// the memory devices under dir, false with the reason when there are none
+bool read_smbios_dimms(const std::string &dir, std::vector<DimmInfo> *dimms, std::string *err);
+
+// the speed the populated DIMMs run at, the slowest configured (or rated)
+// speed, 0 when no entry has one
+uint32_t dimm_speed_mts(const std::vector<DimmInfo> &dimms);
+
+struct ChannelTiming {
+    DramTiming dram;     // tCK and tRFC (0 when the register has none)
+    uint32_t mts;        // transfer rate of the speed bin
+    uint32_t base_trefi, min_trefi, max_trefi;
+    const char *source;  // where the clock came from: "smbios", "register", "checkpoint" or "slowest"
+};
+
+// tCK of a speed bin, 1866 => 1.0714 ns
+double dram_tck_ns(uint32_t mts);
+
+// where the clock comes from when SMBIOS has no speed
+struct ClockFallback {
+    bool trust_register;     // false when the register may hold a tREFI this daemon wrote
+    uint32_t checkpoint_mts; // clock recorded by an earlier run, 0 for none
+    uint32_t memory_type;    // SMBIOS memory type for the slowest bin, 0 when unknown
+
+    ClockFallback() : trust_register(true), checkpoint_mts(0), memory_type(0) {}
+};
+
+// the fallback of a daemon running cfg: the register only counts while cfg
+// has no checkpoint file, then the clock the checkpoint recorded does
+ClockFallback clock_fallback(const RefreshConfig &cfg);
+
+// timing of a channel running mts (0 for the fallback) with the tREFI
+// register value
+ChannelTiming channel_timing(uint32_t mts, uint32_t trefi_reg, const ClockFallback &fallback);
+
+// the timing of every channel of the backend, read before the controller
+// writes tREFI; smbios_dir empty skips SMBIOS, the memory type of the
+// fallback comes from SMBIOS when it has one
+std::vector<ChannelTiming> discover_timing(RegisterBackend &backend, const std::string &smbios_dir, ClockFallback fallback);
+
+// base_trefi and dram_mts defaults from the discovered timing
+void apply_timing(const std::vector<ChannelTiming> &timing, RefreshConfig *defaults);
+
+// the per channel tREFI bounds of the controller
+void apply_timing(const std::vector<ChannelTiming> &timing, ControllerOptions *opt);
+
+void print_timing(std::ostream &out, RegisterBackend &backend, const std::vector<ChannelTiming> &timing);
@@ -0,0 +1,38 @@
+// Memory channel topology: where every socket/iMC/channel lives in PCI config space
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+struct ChannelLocation {
+    uint32_t socket;
+    uint32_t imc;         // memory controller within the socket
+    uint32_t channel;     // channel within the memory controller
+    uint32_t pcm_channel; // channel index within the socket as counted by PCM
+    uint32_t group, bus, device, func, err_func;
+};
+
+typedef std::vector<ChannelLocation> Topology;
+
+// "S0.MC1.CH2"
+inline std::string channel_name(const ChannelLocation &loc) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "S%u.MC%u.CH%u", loc.socket, loc.imc, loc.channel);
+    return buf;
+}
+
+// regular topology without PCI addresses, used by the simulator
+inline Topology make_topology(int sockets, int imcs, int channels_per_imc) {
+    Topology t;
+    for (int s = 0; s < sockets; s++)
+        for (int m = 0; m < imcs; m++)
+            for (int c = 0; c < channels_per_imc; c++) {
+                ChannelLocation loc = {(uint32_t)s, (uint32_t)m, (uint32_t)c, (uint32_t)(m * channels_per_imc + c), 0, 0, 0, 0, 0};
+                t.push_back(loc);
+            }
+    return t;
+}
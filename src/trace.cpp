@@ -0,0 +1,92 @@
+// Binary sample trace, see trace.h
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "address.h"
+#include "trace.h"
+
+// 64 bit, so a corrupt num_channels can not wrap below the real table size
+static uint64_t header_size(uint64_t num_channels) {
+    const uint64_t size = sizeof(TraceHeader) + num_channels * sizeof(TraceChannel);
+    return (size + 7) & ~(uint64_t)7;
+}
+
+bool write_trace_header(FILE *out, const Topology &topo, uint32_t base_trefi) {
+    TraceHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    h.version = TRACE_VERSION;
+    h.header_size = header_size(topo.size());
+    h.record_size = sizeof(TelemetryRecord);
+    h.num_channels = topo.size();
+    h.base_trefi = base_trefi;
+    if (fwrite(&h, sizeof(h), 1, out) != 1)
+        return false;
+
+    for (size_t i = 0; i < topo.size(); i++) {
+        TraceChannel c = {topo[i].socket, topo[i].imc, topo[i].channel, topo[i].pcm_channel};
+        if (fwrite(&c, sizeof(c), 1, out) != 1)
+            return false;
+    }
+    static const char pad[8] = {0};
+    const size_t written = sizeof(h) + topo.size() * sizeof(TraceChannel);
+    return fwrite(pad, 1, h.header_size - written, out) == h.header_size - written;
+}
+
+TraceFile::TraceFile() : map(NULL), map_size(0), hdr(NULL), records(NULL), num_records(0) {}
+
+TraceFile::~TraceFile() {
+    if (map)
+        munmap(map, map_size);
+}
+
+bool TraceFile::open(const char *path, std::string *err) {
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        *err = std::string("can not open ") + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TraceHeader)) {
+        close(fd);
+        *err = "file too short for a trace header";
+        return false;
+    }
+    map_size = st.st_size;
+    map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        *err = "mmap failed";
+        return false;
+    }
+    madvise(map, map_size, MADV_SEQUENTIAL);
+
+    hdr = (const TraceHeader *)map;
+    if (memcmp(hdr->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        *err = "not a dynamicRefresh trace";
+        return false;
+    }
+    if (hdr->version > TRACE_VERSION) {
+        *err = "trace version is newer than this tool";
+        return false;
+    }
+    if (hdr->record_size < sizeof(TelemetryRecord) || hdr->header_size < header_size(hdr->num_channels) || hdr->header_size > map_size) {
+        *err = "corrupt trace header";
+        return false;
+    }
+
+    const TraceChannel *ch = (const TraceChannel *)(hdr + 1);
+    topo.clear();
+    for (uint32_t i = 0; i < hdr->num_channels; i++) {
+        ChannelLocation loc = {ch[i].socket, ch[i].imc, ch[i].channel, ch[i].pcm_channel, 0, 0, 0, 0, 0};
+        topo.push_back(loc);
+    }
+    records = (const char *)map + hdr->header_size;
+    num_records = (map_size - hdr->header_size) / hdr->record_size;
+    return true;
+}
@@ -0,0 +1,61 @@
+// Binary sample trace
+//
+// Layout: TraceHeader, num_channels TraceChannel entries, then fixed-size
+// TelemetryRecords in time order up to the end of the file. Fields are in
+// host byte order and the records start 8 byte aligned, so a trace can be
+// mmap'ed and read in place. A truncated last record is ignored.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "telemetry.h"
+#include "topology.h"
+
+#define TRACE_MAGIC "DRTRACE"
+#define TRACE_VERSION 1
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size; // offset of the first record
+    uint32_t record_size; // sizeof(TelemetryRecord) of the writer
+    uint32_t num_channels;
+    uint32_t base_trefi;
+    uint32_t reserved;
+};
+
+struct TraceChannel {
+    uint32_t socket, imc, channel, pcm_channel;
+};
+
+// base_trefi is the one the run used, replay starts from it
+bool write_trace_header(FILE *out, const Topology &topo, uint32_t base_trefi);
+
+// read-only mmap view of a trace file
+class TraceFile {
+  public:
+    TraceFile();
+    ~TraceFile();
+
+    bool open(const char *path, std::string *err);
+
+    const TraceHeader &header() const { return *hdr; }
+    const Topology &topology() const { return topo; }
+    size_t size() const { return num_records; }
+    const TelemetryRecord &operator[](size_t i) const { return *(const TelemetryRecord *)(records + i * hdr->record_size); }
+
+    TraceFile(const TraceFile &) = delete;
+    TraceFile &operator=(const TraceFile &) = delete;
+
+  private:
+    void *map;
+    size_t map_size;
+    const TraceHeader *hdr;
+    const char *records;
+    size_t num_records;
+    Topology topo;
+};